@@ -0,0 +1,94 @@
+# Writes config.json for a synthetic benchmark world of about n agents.
+#
+#   awk -v n=1000 [-v threads=4] [-v steps=1000] [-v commit=abc123] 
+#       [-v scenario=mixed] [-v options='"key": value, ...'] [-v label='"key": value, ...']
+#       -f generate.awk
+#
+# Agents are put in the cells of a square grid, one per 40x40 cell in a
+# shuffled order, so none overlap and the density is the same at every 
+# size. Of every 20 cells, 9 hold wanderers, 7 omni movers and 4 small 
+# static obstacles, except that every 500th cell, starting with the 
+# first, holds a spawner. This is the "mixed" scenario. In the "sensors"
+# scenario, every mobile agent is a wanderer, and there are no spawners, 
+# so that range sensors dominate the update.
+#
+# Options are extra members for the configuration, and are copied into
+# the "bench" label along with label and the scenario.
+
+function item(text) {
+    printf "%s\n        %s", ( count++ ? "," : "" ), text
+}
+
+BEGIN {
+
+    if ( scenario == "" ) scenario = "mixed"
+    extra = options == "" ? "" : ", " options
+    extra_label = label == "" ? "" : ", " label
+
+    srand(n)
+    cell = 40
+    side = int(sqrt(n)) + 1
+    half = side * cell / 2
+
+    # Shuffled grid cells
+    for ( i=0; i<side*side; i++ ) order[i] = i
+    for ( i=side*side-1; i>0; i-- ) {
+        j = int(rand() * (i+1))
+        t = order[i]; order[i] = order[j]; order[j] = t
+    }
+
+    printf "{\n"
+    printf "    \"name\": \"Benchmark, %d agents\",\n", n
+    printf "    \"ip\": \"0.0.0.0\",\n"
+    printf "    \"port\": 8765,\n"
+    printf "    \"controller_threads\": %d,\n", threads
+    printf "    \"bench\": { \"scenario\": \"%s\", \"agents\": %d, \"steps\": %d, \"threads\": %d, \"commit\": \"%s\"%s%s },\n", 
+           scenario, n, steps, threads, commit, extra, extra_label
+    if ( options != "" ) printf "    %s,\n", options
+    printf "    \"references\": [],\n"
+    printf "    \"invisibles\": [],\n"
+
+    # Mobile agents and spawners
+    printf "    \"agents\": ["
+    count = 0
+    for ( i=0; i<n; i++ ) {
+        x = ( order[i] % side + 0.5 ) * cell - half
+        y = ( int(order[i] / side) + 0.5 ) * cell - half
+        theta = rand() * 6.283
+        if ( scenario == "sensors" ) {
+            if ( i % 20 >= 16 ) continue
+            def = "wanderer"; fill = "lightblue"
+        } else if ( i % 500 == 0 ) {
+            def = "spawner"; fill = "orange"
+        } else if ( i % 20 < 9 ) {
+            def = "wanderer"; fill = "lightblue"
+        } else if ( i % 20 < 16 ) {
+            def = "mover"; fill = "lightgreen"
+        } else {
+            continue
+        }
+        item(sprintf("{ \"definition\": \"defs/%s.json\", \"style\": { \"fill\": \"%s\", \"stroke\": \"black\" }, \"position\": { \"x\": %.1f, \"y\": %.1f, \"theta\": %.3f } }", def, fill, x, y, theta))
+    }
+    printf "\n    ],\n"
+
+    # Obstacles, and walls around the grid
+    printf "    \"statics\": ["
+    count = 0
+    style = "\"style\": { \"fill\": \"gray\", \"stroke\": \"none\" }"
+    for ( i=0; i<n; i++ ) {
+        if ( ( scenario == "sensors" || i % 500 != 0 ) && i % 20 >= 16 ) {
+            x = ( order[i] % side + 0.5 ) * cell - half
+            y = ( int(order[i] / side) + 0.5 ) * cell - half
+            item(sprintf("{ %s, \"shape\": [ { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f } ] }", 
+                         style, x-8, y-8, x-8, y+8, x+8, y+8, x+8, y-8))
+        }
+    }
+    w = half + 10
+    item(sprintf("{ %s, \"shape\": [ { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f } ] }", style, -w, -w, -w, w, -half, w, -half, -w))
+    item(sprintf("{ %s, \"shape\": [ { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f } ] }", style, half, -w, half, w, w, w, w, -w))
+    item(sprintf("{ %s, \"shape\": [ { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f } ] }", style, -w, -w, -w, -half, w, -half, w, -w))
+    item(sprintf("{ %s, \"shape\": [ { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f }, { \"x\": %.1f, \"y\": %.1f } ] }", style, -w, half, -w, w, w, w, w, half))
+    printf "\n    ]\n"
+    printf "}\n"
+
+}
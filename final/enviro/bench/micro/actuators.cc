@@ -0,0 +1,51 @@
+#include "micro.h"
+
+using namespace micro;
+
+// The actuators that controllers call every tick. Before definitions were
+// decoded into AGENT_PARAMETERS, each call copied the definition json twice
+// to read the friction coefficients and compared the type as a string.
+// The "json" timings add exactly those reads to each call, as the old
+// getters did them, to show what the parameter block saves.
+
+MICRO_CASE(actuators) {
+
+    double seconds = options["quick"] ? 0.02 : 0.2;
+
+    Sandbox sandbox;
+    Agent& a = sandbox.add(definition("actuator_probe", "square", 10), 0, 0);
+    Agent& b = sandbox.add(definition("omni_actuator_probe", "omni", 10), 100, 0);
+    sandbox.update();
+
+    auto old_getters = [](Agent& agent) {
+        json d = agent.definition();
+        bool is_static = d["type"] == "static";
+        json f = d["friction"];
+        double kL = f["linear"].get<double>();
+        json g = d["friction"];
+        double kR = g["rotational"].get<double>();
+        keep(is_static);
+        keep(kL);
+        keep(kR);
+    };
+
+    double apply = ns_per_call([&]() { a.apply_force(1, 0.1); }, seconds);
+    double omni = ns_per_call([&]() { b.omni_apply_force(1, 1); }, seconds);
+    double apply_json = ns_per_call([&]() {
+        old_getters(a);
+        a.apply_force(1, 0.1);
+    }, seconds);
+    double omni_json = ns_per_call([&]() {
+        old_getters(b);
+        b.omni_apply_force(1, 1);
+    }, seconds);
+
+    return {
+        { "ns_per_apply_force", apply },
+        { "ns_per_apply_force_json", apply_json },
+        { "ns_per_omni_apply_force", omni },
+        { "ns_per_omni_apply_force_json", omni_json },
+        { "speedup", ( apply_json + omni_json ) / ( apply + omni ) }
+    };
+
+}
@@ -0,0 +1,97 @@
+#include "micro.h"
+
+using namespace micro;
+
+// Chains of agents pinned together with attach_to, as in a rope or a
+// snake. Times pinning, attachment checks through the adjacency index and,
+// for comparison, through a scan of every joint as they were found before
+// the index, world updates with the chain in place and removing it.
+
+MICRO_CASE(chains) {
+
+    json results = json::object();
+    double seconds = options["quick"] ? 0.02 : 0.2;
+    std::vector<int> sizes = options["quick"] ? std::vector<int>{ 100, 1000 } : std::vector<int>{ 1000, 4000, 16000 };
+    bool ok = true;
+
+    for ( int n : sizes ) {
+
+        Sandbox sandbox;
+        World& world = sandbox.world();
+        json def = definition("link", "omni", 4);
+        std::vector<Agent *> links;
+        for ( int i=0; i<n; i++ ) {
+            links.push_back(&sandbox.add(def, 10 * ( i % 200 ), 10 * ( i / 200 )));
+        }
+        sandbox.update();
+
+        long long t0 = now_ns();
+        for ( int i=0; i+1<n; i++ ) {
+            world.add_constraint(*links[i], *links[i+1]);
+        }
+        double pin = ( now_ns() - t0 ) / (double) ( n - 1 );
+        sandbox.update();
+
+        std::vector<std::pair<int, int>> joints;
+        for ( int i=0; i+1<n; i++ ) {
+            joints.push_back({ links[i]->get_id(), links[i+1]->get_id() });
+        }
+
+        int k = 0;
+        double check = ns_per_call([&]() {
+            int i = k++ % ( n - 1 );
+            keep(world.attached(*links[i+1], *links[i]));
+        }, seconds);
+        double scan = ns_per_call([&]() {
+            int i = k++ % ( n - 1 );
+            int a = links[i+1]->get_id(), b = links[i]->get_id();
+            bool found = false;
+            for ( auto& j : joints ) {
+                if ( ( j.first == a && j.second == b ) || ( j.first == b && j.second == a ) ) {
+                    found = true;
+                    break;
+                }
+            }
+            keep(found);
+        }, seconds);
+
+        for ( int i=0; i+1<n; i++ ) {
+            ok = ok && world.attached(*links[i], *links[i+1]) && world.attached(*links[i+1], *links[i]);
+        }
+        ok = ok && !world.attached(*links[0], *links[n-1]);
+
+        int updates = options["quick"] ? 5 : 50;
+        t0 = now_ns();
+        for ( int u=0; u<updates; u++ ) {
+            sandbox.update();
+        }
+        double update = ( now_ns() - t0 ) / 1e6 / updates;
+
+        // Every other link goes, which breaks every joint
+        int removed = 0;
+        for ( int i=0; i<n; i+=2 ) {
+            world.remove(links[i]->get_id());
+            removed++;
+        }
+        t0 = now_ns();
+        sandbox.update();
+        double removal = ( now_ns() - t0 ) / 1e6;
+        for ( int i=1; i+1<n; i+=2 ) {
+            ok = ok && world.exists(links[i]->get_id()) && !world.attached(*links[i], *links[i+1]);
+        }
+
+        results[std::to_string(n)] = {
+            { "ns_per_pin", pin },
+            { "ns_per_attached", check },
+            { "ns_per_scan_attached", scan },
+            { "ms_per_update", update },
+            { "ms_to_remove", removal },
+            { "removed", removed }
+        };
+
+    }
+
+    results["ok"] = ok;
+    return results;
+
+}
@@ -0,0 +1,92 @@
+#include "micro.h"
+#include "state_encoder.h"
+
+using namespace micro;
+
+// Bytes and nanoseconds per agent for each way the server sends a frame:
+// the /state json document, a /stream keyframe, and /state?format=binary,
+// compact and quantized, for a client that already holds the string
+// table. Agents are of four types with two styles each, have three sensor
+// readings, and every tenth has a label.
+
+namespace {
+
+    WORLD_FRAME frame(int n) {
+
+        std::vector<std::shared_ptr<const std::string>> definitions, styles, specifications;
+        for ( int t=0; t<4; t++ ) {
+            json d = definition("encode_type_" + std::to_string(t), t % 2 ? "omni" : "square", 10);
+            definitions.push_back(std::make_shared<const std::string>(d.dump()));
+            for ( std::string fill : { "red", "blue" } ) {
+                json style = { { "fill", fill }, { "stroke", "black" } };
+                styles.push_back(std::make_shared<const std::string>(style.dump()));
+                specifications.push_back(std::make_shared<const std::string>(
+                    json({ { "definition", d }, { "style", style } }).dump()));
+            }
+        }
+
+        WORLD_FRAME f = {};
+        f.number = 1;
+        f.zoom = 1;
+        for ( int i=0; i<n; i++ ) {
+            AGENT_RECORD a = {};
+            a.id = i;
+            a.x = 20 * ( i % 100 ) + 0.37 * i;
+            a.y = 20 * ( i / 100 ) - 0.11 * i;
+            a.theta = 0.01 * i;
+            a.vx = i % 7 - 3;
+            a.vy = i % 5 - 2;
+            a.omega = 0.1 * ( i % 3 );
+            a.sensors = { 10.5 + i % 90, 20.25, 300 };
+            a.definition = definitions[i % 4];
+            a.style = styles[i % 8];
+            a.specification = specifications[i % 8];
+            if ( i % 10 == 0 ) {
+                a.label = "agent " + std::to_string(i);
+                a.label_y = -12;
+            }
+            a.bounds = { a.x - 10, a.y - 10, a.x + 10, a.y + 10 };
+            f.agents.push_back(a);
+        }
+        return f;
+
+    }
+
+}
+
+MICRO_CASE(encode) {
+
+    json results = json::object();
+    double seconds = options["quick"] ? 0.02 : 0.2;
+    std::vector<int> sizes = options["quick"] ? std::vector<int>{ 100, 1000 } : std::vector<int>{ 100, 1000, 10000 };
+
+    for ( int n : sizes ) {
+
+        auto f = std::make_shared<WORLD_FRAME>(frame(n));
+        StateEncoder encoder;
+        size_t first = encoder.encode(*f, 0, 0, false).size();
+        uint32_t table = encoder.table_id(), known = encoder.table_size();
+
+        std::string text, compact, quantized, keyframe;
+        double json_ns = ns_per_call([&]() { text = frame_to_json(*f); }, seconds);
+        double compact_ns = ns_per_call([&]() { compact = encoder.encode(*f, table, known, false); }, seconds);
+        double quantized_ns = ns_per_call([&]() { quantized = encoder.encode(*f, table, known, true); }, seconds);
+        double keyframe_ns = ns_per_call([&]() {
+            StateStream stream(1);
+            stream.publish(f);
+            keyframe = stream.encode(0);
+        }, seconds);
+
+        results[std::to_string(n)] = {
+            { "json", { { "bytes_per_agent", (double) text.size() / n }, { "ns_per_agent", json_ns / n } } },
+            { "keyframe", { { "bytes_per_agent", (double) keyframe.size() / n }, { "ns_per_agent", keyframe_ns / n } } },
+            { "compact", { { "bytes_per_agent", (double) compact.size() / n }, { "ns_per_agent", compact_ns / n } } },
+            { "quantized", { { "bytes_per_agent", (double) quantized.size() / n }, { "ns_per_agent", quantized_ns / n } } },
+            { "first_compact_bytes", first }
+        };
+
+    }
+
+    return results;
+
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <random>
+#include <set>
+#include "micro.h"
+
+using namespace micro;
+
+// Agent lookup by id in a world of 10k agents, through the slot table and
+// through a scan of the agent list, which is how ids were resolved before
+// the table. Also checks that ids stay unique while one slot is reused
+// past its last generation.
+
+MICRO_CASE(lookup) {
+
+    int n = options["quick"] ? 1000 : 10000;
+    double seconds = options["quick"] ? 0.02 : 0.2;
+
+    Sandbox sandbox;
+    json def = definition("lookup_probe", "omni", 5, "noninteractive");
+    for ( int i=0; i<n; i++ ) {
+        sandbox.add(def, 20 * ( i % 100 ), 20 * ( i / 100 ));
+    }
+    sandbox.update();
+
+    World& world = sandbox.world();
+    std::vector<Agent *> agents;
+    world.all([&](Agent& a) { agents.push_back(&a); });
+
+    // A tenth of the agents are removed, so that their ids are stale
+    std::vector<int> live, stale;
+    for ( size_t i=0; i<agents.size(); i++ ) {
+        if ( i % 10 == 0 ) {
+            stale.push_back(agents[i]->get_id());
+            world.remove(agents[i]->get_id());
+        } else {
+            live.push_back(agents[i]->get_id());
+        }
+    }
+    sandbox.update();
+    agents.clear();
+    world.all([&](Agent& a) { agents.push_back(&a); });
+
+    std::mt19937 rng(1);
+    std::shuffle(live.begin(), live.end(), rng);
+
+    size_t i = 0;
+    double table = ns_per_call([&]() {
+        keep(world.lookup(live[i++ % live.size()]));
+    }, seconds);
+    double exists_stale = ns_per_call([&]() {
+        keep(world.exists(stale[i++ % stale.size()]));
+    }, seconds);
+    double scan = ns_per_call([&]() {
+        int id = live[i++ % live.size()];
+        Agent * found = NULL;
+        for ( auto a : agents ) {
+            if ( a->get_id() == id ) {
+                found = a;
+                break;
+            }
+        }
+        keep(found);
+    }, seconds);
+
+    bool ok = true;
+    for ( int id : stale ) {
+        ok = ok && world.lookup(id) == NULL;
+    }
+    for ( int id : live ) {
+        ok = ok && world.lookup(id) != NULL && world.lookup(id)->get_id() == id;
+    }
+
+    // One slot, reused until it is retired, never repeats an id
+    Sandbox churn;
+    std::set<int> seen;
+    int reuses = 2 * ( AGENT_MAX_GENERATION + 1 );
+    for ( int k=0; k<reuses; k++ ) {
+        int id = churn.world().register_agent(agents[0]);
+        ok = ok && seen.insert(id).second;
+        churn.world().release_agent_id(id);
+        ok = ok && churn.world().lookup(id) == NULL;
+    }
+
+    return {
+        { "agents", agents.size() },
+        { "ns_per_lookup", table },
+        { "ns_per_stale_exists", exists_stale },
+        { "ns_per_scan_lookup", scan },
+        { "speedup", scan / table },
+        { "ids_checked", live.size() + stale.size() + reuses },
+        { "ok", ok }
+    };
+
+}
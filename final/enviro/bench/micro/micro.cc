@@ -0,0 +1,106 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include "micro.h"
+
+//   bin/micro [--results FILE] [--quick] [CASE ...]
+//
+// Runs the named cases, or all of them, and appends a json line for each
+// to FILE (default results.jsonl). With --quick, cases use smaller sizes,
+// to check that they run rather than to measure.
+
+namespace micro {
+
+    static std::map<std::string, CASE>& cases() {
+        static std::map<std::string, CASE> c;
+        return c;
+    }
+
+    bool add(const std::string& name, CASE f) {
+        cases()[name] = f;
+        return true;
+    }
+
+    long long now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double ns_per_call(const std::function<void()>& f, double min_seconds) {
+        long long calls = 0, elapsed = 0;
+        for ( long long batch = 1; elapsed < min_seconds * 1e9; batch *= 2 ) {
+            long long t0 = now_ns();
+            for ( long long i=0; i<batch; i++ ) {
+                f();
+            }
+            elapsed += now_ns() - t0;
+            calls += batch;
+        }
+        return (double) elapsed / calls;
+    }
+
+}
+
+int main(int argc, char * argv[]) {
+
+    std::string results = "results.jsonl";
+    json options = { { "quick", false } };
+    std::vector<std::string> names;
+
+    for ( int i=1; i<argc; i++ ) {
+        std::string arg = argv[i];
+        if ( arg == "--results" && i+1 < argc ) {
+            results = argv[++i];
+        } else if ( arg == "--quick" ) {
+            options["quick"] = true;
+        } else if ( micro::cases().count(arg) ) {
+            names.push_back(arg);
+        } else {
+            std::cerr << "usage: micro [--results FILE] [--quick] [CASE ...]\n\ncases:";
+            for ( auto& c : micro::cases() ) {
+                std::cerr << " " << c.first;
+            }
+            std::cerr << "\n";
+            return 1;
+        }
+    }
+    if ( names.empty() ) {
+        for ( auto& c : micro::cases() ) {
+            names.push_back(c.first);
+        }
+    }
+
+    std::ofstream out(results, std::ios::app);
+    if ( out.fail() ) {
+        std::cerr << "Could not open " << results << " for writing\n";
+        return 1;
+    }
+
+    const char * commit = getenv("COMMIT");
+    bool ok = true;
+    for ( auto& name : names ) {
+        std::cout << name << std::flush;
+        long long t0 = micro::now_ns();
+        json r = micro::cases()[name](options);
+        json line = {
+            { "micro", name },
+            { "commit", commit ? commit : "unknown" },
+            { "quick", options["quick"] },
+            { "seconds", ( micro::now_ns() - t0 ) / 1e9 },
+            { "results", r }
+        };
+        out << line.dump() << "\n";
+        out.flush();
+        if ( r.value("ok", true) ) {
+            std::cout << "\n";
+        } else {
+            std::cout << ": FAILED\n";
+            ok = false;
+        }
+    }
+
+    std::cout << "Results appended to " << results << std::endl;
+    return ok ? 0 : 1;
+
+}
@@ -0,0 +1,80 @@
+#ifndef __ENVIRO_BENCH_MICRO__H
+#define __ENVIRO_BENCH_MICRO__H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include "enviro.h"
+
+// Microbenchmarks for the parts of the server that the synthetic worlds in
+// run.sh can not isolate. Each case is a function from options to a json
+// object of results, registered by name with MICRO_CASE, and bin/micro
+// appends one line per case to the results file. A case that checks
+// something as well as timing it sets "ok" to false when the check fails,
+// and bin/micro then exits with an error.
+//
+//   MICRO_CASE(lookup) {
+//       ...
+//       return { { "ns_per_lookup", t } };
+//   }
+
+#define MICRO_CASE(__NAME__)                                                     \
+static json micro_##__NAME__(const json& options);                               \
+static bool __micro_registered_##__NAME__ = micro::add(#__NAME__, micro_##__NAME__); \
+static json micro_##__NAME__(const json& options)
+
+namespace micro {
+
+    using namespace enviro;
+
+    typedef json (*CASE)(const json& options);
+
+    //! Registers a case. Returns true, so it can initialize a static.
+    bool add(const std::string& name, CASE f);
+
+    //! Calls f in growing batches until at least min_seconds have passed,
+    //! and returns the mean nanoseconds per call.
+    double ns_per_call(const std::function<void()>& f, double min_seconds = 0.2);
+
+    //! Nanoseconds on the steady clock.
+    long long now_ns();
+
+    //! Keeps the compiler from optimizing away a value that is never used.
+    template<class T> inline void keep(const T& value) {
+        asm volatile("" : : "g"(&value) : "memory");
+    }
+
+    //! A definition for an agent type with no controller of its own. Shape
+    //! is "omni" for a circle of the given size, or otherwise a square of
+    //! that half width. Type is "dynamic", "static", "noninteractive" or
+    //! "invisible".
+    json definition(const std::string& name, const std::string& shape = "omni", double size = 10,
+                    const std::string& type = "dynamic", json sensors = json::array());
+
+    //! A world for a case to fill, with no agents of its own. Changes are
+    //! merged over a minimal configuration. The world's manager is started,
+    //! so update() can be called directly.
+    class Sandbox {
+
+        public:
+
+        Sandbox(json changes = json::object());
+
+        //! Adds an agent of the type with the given definition, which is
+        //! loaded the first time it is used. The agent joins the world on
+        //! the next update.
+        Agent& add(const json& definition, double x, double y, double theta = 0);
+
+        inline World& world() { return *_world; }
+        inline void update() { _world->update(); }
+
+        private:
+
+        elma::Manager _manager;
+        std::unique_ptr<World> _world;
+
+    };
+
+}
+
+#endif
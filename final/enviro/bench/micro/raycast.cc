@@ -0,0 +1,148 @@
+#include <random>
+#include "micro.h"
+
+using namespace micro;
+
+// Range sensor rays through a scene of circles, rotated squares and static
+// walls, cast by the raycaster's scalar and AVX2 kernels and by
+// cpSpaceSegmentQueryFirst with the filter sensors used before the
+// raycaster. Every ray must give the same distance and type of agent all
+// three ways. Rays that start inside two shapes at once hit both at
+// alpha 0, and which one wins is up to Chipmunk's tree, so a different
+// type there is counted as a tie rather than a mismatch.
+
+namespace {
+
+    typedef struct {
+        cpVect start, end;
+        cpGroup group;
+    } RAY;
+
+    typedef struct {
+        bool hit;
+        double distance;
+        int type;
+    } READING;
+
+    READING chipmunk(cpSpace * space, const RAY& ray) {
+        cpShapeFilter filter = cpShapeFilterNew(ray.group, CP_ALL_CATEGORIES, AGENT_SENSOR_CATEGORY);
+        cpSegmentQueryInfo info;
+        cpShape * shape = cpSpaceSegmentQueryFirst(space, ray.start, ray.end, 0, filter, &info);
+        if ( shape == NULL ) {
+            return { false, 0, -1 };
+        }
+        Agent * other = (Agent *) cpBodyGetUserData(cpShapeGetBody(shape));
+        return { true, cpvdist(ray.start, info.point), other->get_type_id() };
+    }
+
+    READING raycaster(Raycaster& r, const RAY& ray) {
+        RAYCAST_HIT hit;
+        if ( !r.cast(ray.start, ray.end, ray.group, hit) ) {
+            return { false, 0, -1 };
+        }
+        return { true, cpvdist(ray.start, hit.point), hit.type };
+    }
+
+}
+
+MICRO_CASE(raycast) {
+
+    int n = options["quick"] ? 500 : 5000;
+    int num_rays = options["quick"] ? 2000 : 100000;
+    double seconds = options["quick"] ? 0.02 : 0.2;
+    double side = 30 * sqrt(n);
+
+    Sandbox sandbox;
+    World& world = sandbox.world();
+    std::mt19937 random(520);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    std::vector<json> defs = {
+        definition("raycast_small_circle", "omni", 5),
+        definition("raycast_large_circle", "omni", 15),
+        definition("raycast_square", "square", 8),
+        definition("raycast_wall", "square", 30, "static")
+    };
+    std::vector<Agent *> agents;
+    for ( int i=0; i<n; i++ ) {
+        agents.push_back(&sandbox.add(defs[i % defs.size()], side * uniform(random), side * uniform(random),
+                                      2 * M_PI * uniform(random)));
+    }
+    sandbox.update();
+
+    // Half the rays start at an agent and skip its shape, as sensors do,
+    // and half start anywhere and see everything
+    std::vector<RAY> rays;
+    for ( int i=0; i<num_rays; i++ ) {
+        double angle = 2 * M_PI * uniform(random);
+        RAY ray;
+        if ( i % 2 == 0 ) {
+            Agent * a = agents[random() % n];
+            ray.start = a->position();
+            ray.group = a->get_shape_group();
+        } else {
+            ray.start = cpv(side * uniform(random), side * uniform(random));
+            ray.group = CP_NO_GROUP;
+        }
+        ray.end = cpvadd(ray.start, cpv(1000 * cos(angle), 1000 * sin(angle)));
+        rays.push_back(ray);
+    }
+
+    Raycaster scalar, avx2;
+    scalar.configure(world.get_space(), "scalar", 64);
+    avx2.configure(world.get_space(), "auto", 64);
+    bool has_avx2 = avx2.kernel() == RAYCAST_AVX2;
+
+    int hits = 0, mismatches = 0, ties = 0;
+    json examples = json::array();
+    for ( auto& ray : rays ) {
+        READING c = chipmunk(world.get_space(), ray);
+        hits += c.hit;
+        for ( Raycaster * r : { &scalar, &avx2 } ) {
+            READING s = raycaster(*r, ray);
+            if ( s.hit == c.hit && s.distance == c.distance && s.type == c.type ) {
+                continue;
+            } else if ( s.hit && c.hit && s.distance == 0 && c.distance == 0 ) {
+                ties++;
+            } else {
+                mismatches++;
+                if ( examples.size() < 5 ) {
+                    examples.push_back({
+                        { "kernel", r == &scalar ? "scalar" : "avx2" },
+                        { "start", { ray.start.x, ray.start.y } },
+                        { "end", { ray.end.x, ray.end.y } },
+                        { "distance", s.distance },
+                        { "type", s.type },
+                        { "chipmunk_distance", c.distance },
+                        { "chipmunk_type", c.type }
+                    });
+                }
+            }
+        }
+    }
+
+    int k = 0;
+    double chipmunk_ns = ns_per_call([&]() { keep(chipmunk(world.get_space(), rays[k++ % num_rays])); }, seconds);
+    double scalar_ns = ns_per_call([&]() { keep(raycaster(scalar, rays[k++ % num_rays])); }, seconds);
+    double avx2_ns = ns_per_call([&]() { keep(raycaster(avx2, rays[k++ % num_rays])); }, seconds);
+
+    json results = {
+        { "shapes", n },
+        { "rays", num_rays },
+        { "hits", hits },
+        { "avx2", has_avx2 },
+        { "mismatches", mismatches },
+        { "ties", ties },
+        { "ns_per_chipmunk_cast", chipmunk_ns },
+        { "ns_per_scalar_cast", scalar_ns },
+        { "ns_per_avx2_cast", avx2_ns },
+        { "scalar_speedup", chipmunk_ns / scalar_ns },
+        { "avx2_speedup", chipmunk_ns / avx2_ns },
+        { "ok", mismatches == 0 }
+    };
+    if ( !examples.empty() ) {
+        results["examples"] = examples;
+    }
+    return results;
+
+}
@@ -0,0 +1,67 @@
+#include "micro.h"
+
+namespace micro {
+
+    // Agents of every micro type are plain agents without processes, built
+    // through the registry instead of a shared object
+    class Probe : public Agent {
+        public:
+        Probe(json spec, World& world) : Agent(spec, world) {}
+    };
+
+    static bool __probe_registered = AgentRegistry::add("micro/probe", {
+        [](json spec, World& world) -> Agent* { return new Probe(spec, world); },
+        [](Agent* object) { delete static_cast<Probe*>(object); },
+        []() -> size_t { return sizeof(Probe); },
+        [](void * memory, json spec, World& world) -> Agent* { return new (memory) Probe(spec, world); },
+        [](Agent* object) { static_cast<Probe*>(object)->~Probe(); }
+    });
+
+    json definition(const std::string& name, const std::string& shape, double size,
+                    const std::string& type, json sensors) {
+        json d = {
+            { "name", name },
+            { "type", type },
+            { "description", "A " + name + " for the microbenchmarks" },
+            { "friction", { { "collision", 0.5 }, { "linear", 10 }, { "rotational", 200 } } },
+            { "sensors", sensors },
+            { "mass", 1 },
+            { "controller", "micro/probe" }
+        };
+        if ( shape == "omni" ) {
+            d["shape"] = "omni";
+            d["radius"] = size;
+        } else {
+            d["shape"] = {
+                { { "x", -size }, { "y", -size } },
+                { { "x", -size }, { "y", size } },
+                { { "x", size }, { "y", size } },
+                { { "x", size }, { "y", -size } }
+            };
+        }
+        return d;
+    }
+
+    Sandbox::Sandbox(json changes) {
+        json config = {
+            { "name", "Microbenchmark" },
+            { "ip", "0.0.0.0" },
+            { "port", 8765 },
+            { "agents", json::array() },
+            { "references", json::array() },
+            { "invisibles", json::array() },
+            { "statics", json::array() }
+        };
+        config.merge_patch(changes);
+        _world.reset(new World(config, _manager));
+        _manager.schedule(*_world, _world->get_step_period());
+        _manager.init();
+        _manager.start();
+    }
+
+    Agent& Sandbox::add(const json& definition, double x, double y, double theta) {
+        _world->add_agent_type({ { "definition", definition } });
+        return _world->add_agent(definition["name"], x, y, theta, { { "fill", "gray" } });
+    }
+
+}
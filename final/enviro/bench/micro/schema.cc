@@ -0,0 +1,137 @@
+#include "micro.h"
+
+using namespace micro;
+
+// Checking a large config against ENVIRO_CONFIG_SCHEMA, in megabytes of
+// serialized json per second, with a compiled schema and with the
+// recursive check that copied the document and the schema at every level,
+// kept here as it was. Also checks that documents that do not match are
+// rejected with the JSON pointer of the first mismatch.
+
+namespace {
+
+    // The check before json_helper::Schema, without its error messages
+    void copying_check(json object, json schema) {
+        if ( schema.is_number() ) {
+            if ( !object.is_number() ) throw std::runtime_error("number");
+        } else if ( schema.is_string() ) {
+            if ( !object.is_string() ) throw std::runtime_error("string");
+        } else if ( schema.is_array() ) {
+            if ( !object.is_array() ) throw std::runtime_error("array");
+            for ( auto& element : object ) {
+                copying_check(element, schema[0]);
+            }
+        } else if ( schema.is_object() ) {
+            if ( !object.is_object() ) throw std::runtime_error("object");
+            for ( auto& [key, value] : schema.items() ) {
+                if ( object.find(key) == object.end() ) throw std::runtime_error(key);
+                copying_check(object[key], value);
+            }
+        }
+    }
+
+    json config(int n) {
+        json c = {
+            { "name", "Schema" },
+            { "ip", "0.0.0.0" },
+            { "port", 8765 },
+            { "agents", json::array() },
+            { "references", json::array() },
+            { "invisibles", json::array() },
+            { "statics", json::array() }
+        };
+        for ( int i=0; i<n; i++ ) {
+            c["agents"].push_back({
+                { "definition", "defs/robot.json" },
+                { "style", { { "stroke", "black" }, { "fill", "gray" } } },
+                { "position", { { "x", i % 100 }, { "y", i / 100 }, { "theta", 0.5 } } }
+            });
+        }
+        for ( int i=0; i<n/10; i++ ) {
+            c["statics"].push_back({
+                { "style", { { "stroke", "none" }, { "fill", "black" } } },
+                { "shape", { { { "x", 0 }, { "y", i } }, { { "x", 10 }, { "y", i } }, { { "x", 10 }, { "y", i + 5 } } } }
+            });
+        }
+        return c;
+    }
+
+    // The message check gives for a document, or "" if it matches
+    std::string error(const json_helper::Schema& schema, const json& object) {
+        try {
+            schema.check(object);
+        } catch ( const std::runtime_error& e ) {
+            return e.what();
+        }
+        return "";
+    }
+
+}
+
+MICRO_CASE(schema) {
+
+    int n = options["quick"] ? 2000 : 20000;
+    double seconds = options["quick"] ? 0.02 : 0.5;
+
+    json document = config(n);
+    double megabytes = document.dump().size() / 1e6;
+
+    long long t0 = now_ns();
+    json_helper::Schema schema(ENVIRO_CONFIG_SCHEMA);
+    double compile = now_ns() - t0;
+
+    double compiled = ns_per_call([&]() { schema.check(document); }, seconds);
+    double copying = ns_per_call([&]() { copying_check(document, ENVIRO_CONFIG_SCHEMA); }, seconds);
+
+    // Each broken document and the start of the message it should give
+    std::vector<std::pair<json, std::string>> broken;
+    json d = document;
+    d["agents"][n/2]["position"]["y"] = "oops";
+    broken.push_back({ d, "JSON Error: Expected number at /agents/" + std::to_string(n/2) + "/position/y but got \"oops\"" });
+    d = document;
+    d["statics"][3]["shape"][1].erase("x");
+    broken.push_back({ d, "JSON Error: Expected key 'x' in object at /statics/3/shape/1" });
+    d = document;
+    d["port"] = json::array({ 1, 2 });
+    broken.push_back({ d, "JSON Error: Expected number at /port but got [1,2]" });
+    d = document;
+    d.erase("name");
+    broken.push_back({ d, "JSON Error: Expected key 'name' in object at the root" });
+    d = document;
+    d["references"] = std::string(200, 'x');
+    broken.push_back({ d, "JSON Error: Expected array at /references but got \"" + std::string(76, 'x') + "..." });
+
+    bool ok = error(schema, document).empty();
+    json failures = json::array();
+    for ( auto& b : broken ) {
+        std::string message = error(schema, b.first);
+        if ( message != b.second ) {
+            failures.push_back({ { "expected", b.second }, { "got", message } });
+            ok = false;
+        }
+    }
+
+    // Keys that need escaping in a pointer
+    json escaped = { { "a/b", { { "c~d", 0 } } } };
+    std::string message = error(json_helper::Schema(escaped), { { "a/b", { { "c~d", "zero" } } } });
+    if ( message != "JSON Error: Expected number at /a~1b/c~0d but got \"zero\"" ) {
+        failures.push_back({ { "got", message } });
+        ok = false;
+    }
+
+    json results = {
+        { "agents", n },
+        { "megabytes", megabytes },
+        { "us_to_compile", compile / 1e3 },
+        { "ms_per_check", compiled / 1e6 },
+        { "ms_per_copying_check", copying / 1e6 },
+        { "megabytes_per_second", megabytes / ( compiled / 1e9 ) },
+        { "copying_megabytes_per_second", megabytes / ( copying / 1e9 ) },
+        { "ok", ok }
+    };
+    if ( !failures.empty() ) {
+        results["failures"] = failures;
+    }
+    return results;
+
+}
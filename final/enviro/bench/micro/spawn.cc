@@ -0,0 +1,78 @@
+#include "micro.h"
+
+using namespace micro;
+
+// Spawn churn, as a spawner sees it: a batch of agents is added, joins the
+// world, and is removed again, round after round. Agents of the pooled
+// type are built in their type's recycled storage, and those of the
+// unpooled type are allocated and freed each time, the way types built
+// with an older DECLARE_INTERFACE still are. Both reuse bodies and shapes.
+
+namespace {
+
+    class UnpooledProbe : public Agent {
+        public:
+        UnpooledProbe(json spec, World& world) : Agent(spec, world) {}
+    };
+
+    bool registered = AgentRegistry::add("micro/unpooled_probe", {
+        [](json spec, World& world) -> Agent* { return new UnpooledProbe(spec, world); },
+        [](Agent* object) { delete static_cast<UnpooledProbe*>(object); },
+        NULL, NULL, NULL
+    });
+
+    // Agents spawned and removed per second
+    double churn(json def, int batch, int rounds) {
+
+        Sandbox sandbox;
+        World& world = sandbox.world();
+        std::string name = def["name"];
+        std::vector<int> ids;
+
+        sandbox.add(def, 0, 0);
+        long long t0 = 0;
+        for ( int r=-2; r<rounds; r++ ) {
+            if ( r == 0 ) {
+                // Removed agents are recycled at the start of the update
+                // after next, so the first two rounds fill the pools
+                t0 = now_ns();
+            }
+            ids.clear();
+            for ( int i=0; i<batch; i++ ) {
+                ids.push_back(world.add_agent(name, 30 * ( i % 50 ), 30 * ( i / 50 ) + 30, 0, { { "fill", "gray" } }).get_id());
+            }
+            sandbox.update();
+            for ( int id : ids ) {
+                world.remove(id);
+            }
+            sandbox.update();
+        }
+        return (double) batch * rounds / ( ( now_ns() - t0 ) / 1e9 );
+
+    }
+
+}
+
+MICRO_CASE(spawn) {
+
+    int batch = options["quick"] ? 100 : 1000;
+    int rounds = options["quick"] ? 5 : 100;
+
+    json results = json::object();
+    for ( std::string shape : { "omni", "square" } ) {
+        json pooled = definition("spawn_" + shape, shape, 5),
+             unpooled = definition("unpooled_spawn_" + shape, shape, 5);
+        unpooled["controller"] = "micro/unpooled_probe";
+        double p = churn(pooled, batch, rounds),
+               u = churn(unpooled, batch, rounds);
+        results[shape] = {
+            { "spawns_per_second", p },
+            { "unpooled_spawns_per_second", u },
+            { "speedup", p / u }
+        };
+    }
+    results["batch"] = batch;
+    results["rounds"] = rounds;
+    return results;
+
+}
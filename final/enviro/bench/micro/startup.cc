@@ -0,0 +1,62 @@
+#include <fstream>
+#include <unistd.h>
+#include "micro.h"
+
+using namespace micro;
+
+// Building a world whose config lists many agents that all share one
+// definition file. The first world reads and checks the file once; a
+// second world with the same file finds it in the definition cache. The
+// "per_entry" timing reads and checks the file once for every entry, as
+// build_specification did before the cache, without building anything.
+
+MICRO_CASE(startup) {
+
+    int n = options["quick"] ? 1000 : 10000;
+
+    char path[] = "/tmp/enviro_micro_startup_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    std::ofstream(path) << definition("startup_probe", "omni", 5).dump(4);
+
+    json agents = json::array();
+    for ( int i=0; i<n; i++ ) {
+        agents.push_back({
+            { "definition", path },
+            { "style", { { "fill", "gray" } } },
+            { "position", { { "x", 30 * ( i % 100 ) }, { "y", 30 * ( i / 100 ) }, { "theta", 0 } } }
+        });
+    }
+    json config = { { "agents", agents } };
+
+    long long t0 = now_ns();
+    std::unique_ptr<Sandbox> first(new Sandbox(config));
+    double cold = ( now_ns() - t0 ) / 1e6;
+    first.reset();
+
+    t0 = now_ns();
+    std::unique_ptr<Sandbox> second(new Sandbox(config));
+    double warm = ( now_ns() - t0 ) / 1e6;
+    int built = 0;
+    second->world().all([&](Agent&) { built++; });
+    second.reset();
+
+    t0 = now_ns();
+    for ( int i=0; i<n; i++ ) {
+        json d = json_helper::read(path);
+        json_helper::check(d, ENVIRO_OMNI_AGENT_SCHEMA);
+        keep(d);
+    }
+    double per_entry = ( now_ns() - t0 ) / 1e6;
+
+    unlink(path);
+
+    return {
+        { "agents", n },
+        { "ms_to_build", cold },
+        { "ms_to_build_cached", warm },
+        { "ms_to_read_per_entry", per_entry },
+        { "ok", built == n }
+    };
+
+}
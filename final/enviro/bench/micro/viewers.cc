@@ -0,0 +1,81 @@
+#include "micro.h"
+#include "response_cache.h"
+
+using namespace micro;
+
+// Server CPU per client when many viewers poll /state for the same frame
+// of 1,000 agents. Each round publishes a new frame and answers every
+// viewer once, through the world's ResponseCache, which serializes the
+// frame once, and, for comparison, by serializing it for each viewer, as
+// the server did before the cache. With gzip, responses are also
+// compressed, once per frame or once per viewer.
+
+namespace {
+
+    WORLD_FRAME frame(int n, std::shared_ptr<const std::string> spec) {
+        WORLD_FRAME f = {};
+        f.zoom = 1;
+        for ( int i=0; i<n; i++ ) {
+            AGENT_RECORD a = {};
+            a.id = i;
+            a.x = 20 * ( i % 40 );
+            a.y = 20 * ( i / 40 );
+            a.theta = 0.1 * i;
+            a.sensors = { 10, 20, 30 };
+            a.specification = spec;
+            f.agents.push_back(a);
+        }
+        return f;
+    }
+
+}
+
+MICRO_CASE(viewers) {
+
+    int responses = options["quick"] ? 20 : 300;
+    auto spec = std::make_shared<const std::string>(
+        "{\"name\":\"robot\",\"definition\":{\"name\":\"robot\",\"type\":\"dynamic\",\"shape\":\"omni\"},\"style\":{\"fill\":\"gray\"}}");
+    WORLD_FRAME f = frame(1000, spec);
+
+    json results = json::object();
+    for ( bool compress : { false, true } ) {
+        json table = json::object();
+        for ( int viewers : { 1, 10, 50, 200 } ) {
+
+            // About the same number of responses for every number of
+            // viewers, so that the uncached runs take the same time
+            int rounds = std::max(2, responses / viewers);
+            ResponseCache cache;
+            long long t0 = now_ns();
+            for ( int r=0; r<rounds; r++ ) {
+                f.number++;
+                for ( int v=0; v<viewers; v++ ) {
+                    keep(cache.get(f.number, "json", compress, [&]() { return frame_to_json(f); }));
+                }
+            }
+            double cached = ( now_ns() - t0 ) / 1e3 / rounds / viewers;
+
+            t0 = now_ns();
+            for ( int r=0; r<rounds; r++ ) {
+                f.number++;
+                for ( int v=0; v<viewers; v++ ) {
+                    std::string text = frame_to_json(f);
+                    keep(compress ? gzip(text) : text);
+                }
+            }
+            double uncached = ( now_ns() - t0 ) / 1e3 / rounds / viewers;
+
+            table[std::to_string(viewers)] = {
+                { "us_per_client", cached },
+                { "uncached_us_per_client", uncached }
+            };
+
+        }
+        results[compress ? "gzip" : "json"] = table;
+    }
+
+    results["agents"] = f.agents.size();
+    results["responses"] = responses;
+    return results;
+
+}
@@ -0,0 +1,75 @@
+#include "micro.h"
+
+using namespace micro;
+
+// The /state document for a client looking at one part of a growing map.
+// Agents sit on a grid at constant density, so the number in an 800 by
+// 600 view, grown by the default viewport_margin, stays the same while the
+// whole map grows. Times and sizes the document with every agent and with
+// only those in the view. Only polling is culled: /stream sends every
+// agent to every client.
+
+namespace {
+
+    WORLD_FRAME grid(int n, std::shared_ptr<const std::string> spec) {
+        WORLD_FRAME f = {};
+        f.number = 1;
+        f.zoom = 1;
+        int side = (int) ceil(sqrt(n));
+        for ( int i=0; i<n; i++ ) {
+            AGENT_RECORD a = {};
+            a.id = i;
+            a.x = 20 * ( i % side - side / 2 );
+            a.y = 20 * ( i / side - side / 2 );
+            a.theta = 0.1 * i;
+            a.sensors = { 10, 20 };
+            a.specification = spec;
+            a.bounds = { a.x - 5, a.y - 5, a.x + 5, a.y + 5 };
+            f.agents.push_back(a);
+        }
+        return f;
+    }
+
+}
+
+MICRO_CASE(viewport) {
+
+    json results = json::object();
+    double seconds = options["quick"] ? 0.02 : 0.2;
+    std::vector<int> sizes = options["quick"] ? std::vector<int>{ 1000, 10000 } : std::vector<int>{ 1000, 10000, 50000 };
+    auto spec = std::make_shared<const std::string>(
+        "{\"name\":\"robot\",\"definition\":{\"name\":\"robot\",\"type\":\"dynamic\",\"shape\":\"omni\"},\"style\":{\"fill\":\"gray\"}}");
+    bool ok = true;
+
+    BOUNDS view;
+    ok = parse_viewport("view=-400,-300,400,300", 100, view);
+
+    for ( int n : sizes ) {
+
+        WORLD_FRAME f = grid(n, spec);
+        std::string full = frame_to_json(f), culled = frame_to_json(f, &view);
+
+        int visible = 0;
+        for ( auto& a : f.agents ) {
+            visible += overlaps(a.bounds, view);
+        }
+        ok = ok && json::parse(full)["agents"].size() == (size_t) n
+                && json::parse(culled)["agents"].size() == (size_t) visible;
+
+        double all = ns_per_call([&]() { keep(frame_to_json(f)); }, seconds);
+        double some = ns_per_call([&]() { keep(frame_to_json(f, &view)); }, seconds);
+
+        results[std::to_string(n)] = {
+            { "bytes", full.size() },
+            { "culled_bytes", culled.size() },
+            { "ms_to_serialize", all / 1e6 },
+            { "culled_ms_to_serialize", some / 1e6 },
+            { "agents_in_view", visible }
+        };
+
+    }
+
+    results["ok"] = ok;
+    return results;
+
+}
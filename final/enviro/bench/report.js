@@ -0,0 +1,104 @@
+// Summarizes a results file written by run.sh and bin/micro.
+//
+//   node report.js [--histograms] [results.jsonl]
+//
+// World runs are listed one per line, with the fields of their label that
+// vary between runs, followed by totals for processes that ran several
+// worlds. With --histograms, each run's world update times
+// follow as counts per power of two microseconds. Microbenchmarks are
+// listed with their results.
+
+const fs = require("fs");
+
+let args = process.argv.slice(2),
+    histograms = args.includes("--histograms"),
+    file = args.filter(a => a != "--histograms")[0] || "results.jsonl",
+    lines = fs.readFileSync(file, "utf8").split("\n").filter(l => l.trim() != "").map(l => JSON.parse(l)),
+    runs = lines.filter(l => l.bench),
+    micros = lines.filter(l => l.micro);
+
+let ms = s => ( 1000 * s ).toFixed(3),
+    per_read = w => w && w.count > 0 ? ( 1e6 * w.total / w.count ).toFixed(2) : "",
+    pct = x => ( 100 * x ).toFixed(1) + "%";
+
+if ( runs.length > 0 ) {
+
+  // Label fields that are the same in every run are left out
+  let keys = [...new Set(runs.flatMap(r => Object.keys(r.bench)))]
+        .filter(k => k != "steps" && new Set(runs.map(r => JSON.stringify(r.bench[k]))).size > 1),
+      readers = runs.some(r => r.readers && r.readers.threads > 0),
+      columns = [...keys, "startup ms", "tick p50 ms", "tick p99 ms", "tick max ms", "steps/s", "step", "sensor", "controllers",
+                 "sensor us/read", ...( readers ? ["reads/s"] : [] )],
+      rows = runs.map(r => [
+        ...keys.map(k => r.bench[k] === undefined ? "" : String(r.bench[k])),
+        r.startup_seconds === undefined ? "" : ms(r.startup_seconds),
+        ms(r.tick.p50), 
+        ms(r.tick.p99),
+        ms(r.tick.max),
+        ( r.profile.steps / r.wall_seconds ).toFixed(0),
+        pct(r.shares.step),
+        pct(r.shares.sensor),
+        pct(r.shares.controllers),
+        per_read(r.profile.work.sensor),
+        ...( readers ? [r.readers ? r.readers.reads_per_second.toFixed(0) : ""] : [] )
+      ]);
+  print_table(columns, rows);
+
+  // Runs of several worlds in one process are also totalled, one line
+  // per process
+  let groups = new Map();
+  for ( let r of runs.filter(r => r.bench.world !== undefined || r.bench.worlds !== undefined) ) {
+    let { world, ...rest } = r.bench,
+        key = JSON.stringify(rest);
+    if ( !groups.has(key) ) groups.set(key, { bench: rest, runs: [] });
+    groups.get(key).runs.push(r);
+  }
+  if ( groups.size > 0 ) {
+    let group_keys = keys.filter(k => k != "world");
+    console.log("");
+    print_table([...group_keys, "count", "total steps/s", "steps/s per world", "slowest tick p99 ms"],
+      [...groups.values()].map(g => {
+        let rates = g.runs.map(r => r.profile.steps / r.wall_seconds),
+            total = rates.reduce((a, b) => a + b, 0);
+        return [
+          ...group_keys.map(k => g.bench[k] === undefined ? "" : String(g.bench[k])),
+          String(g.runs.length),
+          total.toFixed(0),
+          ( total / g.runs.length ).toFixed(0),
+          ms(Math.max(...g.runs.map(r => r.tick.p99)))
+        ];
+      }));
+  }
+
+  if ( histograms ) {
+    for ( let r of runs ) {
+      let h = r.profile.histogram;
+      if ( !h ) continue;
+      console.log(`\n${keys.map(k => `${k}=${JSON.stringify(r.bench[k])}`).join(" ")}`);
+      h.counts.forEach((c, b) => {
+        if ( c > 0 ) {
+          let lo = b == 0 ? 0 : h.under_us[b-1],
+              hi = h.under_us[b] === null ? "" : h.under_us[b];
+          console.log(`  ${String(lo).padStart(8)} - ${String(hi).padEnd(8)} us  ${String(c).padStart(8)}`);
+        }
+      });
+    }
+  }
+
+}
+
+for ( let m of micros ) {
+  console.log(`\n${m.micro} (${m.commit}${m.quick ? ", quick" : ""})`);
+  for ( let [k, v] of Object.entries(m.results) ) {
+    console.log(`  ${k}: ${typeof v == "object" ? JSON.stringify(v) : v}`);
+  }
+}
+
+function print_table(columns, rows) {
+  let widths = columns.map((c, i) => Math.max(c.length, ...rows.map(r => r[i].length)));
+  let line = r => r.map((x, i) => x.padStart(widths[i])).join("  ");
+  console.log(line(columns));
+  for ( let r of rows ) {
+    console.log(line(r));
+  }
+}
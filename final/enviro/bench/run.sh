@@ -0,0 +1,46 @@
+#!/bin/bash
+#
+# Runs enviro headless on synthetic worlds and appends one json line per
+# run to results.jsonl, for comparing commits. Every combination of the
+# listed sizes and thread counts is run.
+#
+#   ./run.sh
+#   SIZES="100 1000" STEPS=500 THREADS="1 4" ./run.sh
+#   SCENARIO=sensors OPTIONS='"sensor_raycast": "chipmunk"' ./run.sh
+#
+# SCENARIO picks the mix of agents (see generate.awk). OPTIONS are extra
+# config.json members, which are also copied into the run's label, and
+# LABEL adds members to the label alone. Summarize the results with
+# "node report.js".
+#
+# Uses bin/enviro, with the agents compiled in, if "make static" has
+# built it, and otherwise enviro on the path with lib/*.so. Set ENVIRO
+# to use another executable.
+
+set -e
+cd "$(dirname "$0")"
+
+SIZES=${SIZES:-"100 1000 10000 50000"}
+STEPS=${STEPS:-1000}
+THREADS=${THREADS:-0}
+SCENARIO=${SCENARIO:-mixed}
+RESULTS=${RESULTS:-$PWD/results.jsonl}
+if [ -z "$ENVIRO" ]; then
+    if [ -x bin/enviro ]; then ENVIRO=$PWD/bin/enviro; else ENVIRO=enviro; fi
+fi
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+
+for n in $SIZES; do
+    for t in $THREADS; do
+        dir=runs/$SCENARIO-$n-$t
+        mkdir -p $dir
+        ln -sfn ../../defs $dir/defs
+        ln -sfn ../../lib $dir/lib
+        awk -v n=$n -v threads=$t -v steps=$STEPS -v commit=$COMMIT -v scenario=$SCENARIO \
+            -v options="$OPTIONS" -v label="$LABEL" -f generate.awk > $dir/config.json
+        echo "$SCENARIO: $n agents, $t threads, $STEPS steps"
+        ( cd $dir && "$ENVIRO" --bench "$RESULTS" --steps $STEPS --output state.jsonl )
+    done
+done
+
+echo "Results appended to $RESULTS"
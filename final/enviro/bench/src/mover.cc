@@ -0,0 +1,4 @@
+#include "mover.h"
+
+// Note : All implementation is in mover.h, but the Makefile
+//        needs a .cc file to know what .so files to make
@@ -0,0 +1,45 @@
+#ifndef __MOVER_AGENT__H
+#define __MOVER_AGENT__H 
+
+#include "enviro.h"
+
+using namespace enviro;
+
+class MoverController : public Process, public AgentInterface {
+
+    public:
+    MoverController() : Process(), AgentInterface() {}
+
+    void init() {}
+    void start() {
+        t = 0;
+        i = id() % 4;
+    }
+    void update() {
+        // Drive around a square, changing direction every four seconds
+        if ( ++t > 40 ) {
+            t = 0;
+            i = (i+1)%4;
+        }
+        omni_track_velocity(5*vx[i], 5*vy[i]);
+    }
+    void stop() {}
+
+    int t, i;
+    const std::vector<double> vx = { 1, 0, -1, 0 };
+    const std::vector<double> vy = { 0, 1, 0, -1 };
+
+};
+
+class Mover : public Agent {
+    public:
+    Mover(json spec, World& world) : Agent(spec, world) {
+        add_process(c);
+    }
+    private:
+    MoverController c;
+};
+
+DECLARE_INTERFACE(Mover)
+
+#endif
@@ -0,0 +1,4 @@
+#include "spawner.h"
+
+// Note : All implementation is in spawner.h, but the Makefile
+//        needs a .cc file to know what .so files to make
@@ -0,0 +1,50 @@
+#ifndef __SPAWNER_AGENT__H
+#define __SPAWNER_AGENT__H 
+
+#include <deque>
+#include <math.h>
+#include "enviro.h"
+
+using namespace enviro;
+
+#define SPAWNER_POPULATION 20 // movers each spawner keeps alive
+
+class SpawnerController : public Process, public AgentInterface {
+
+    public:
+    SpawnerController() : Process(), AgentInterface() {}
+
+    void init() {}
+    void start() {
+        k = 0;
+    }
+    void update() {
+        // One new mover per update, on a spiral around the spawner, and
+        // the oldest one goes once there are enough
+        double a = 2.4 * k++, r = 20 + 10 * ( k % 4 );
+        spawned.push_back(add_agent("Mover", x() + r * cos(a), y() + r * sin(a), 0, 
+                                    { { "fill", "orange" }, { "stroke", "black" } }).get_id());
+        if ( spawned.size() > SPAWNER_POPULATION ) {
+            remove_agent(spawned.front());
+            spawned.pop_front();
+        }
+    }
+    void stop() {}
+
+    int k;
+    std::deque<int> spawned;
+
+};
+
+class Spawner : public Agent {
+    public:
+    Spawner(json spec, World& world) : Agent(spec, world) {
+        add_process(c);
+    }
+    private:
+    SpawnerController c;
+};
+
+DECLARE_INTERFACE(Spawner)
+
+#endif
@@ -0,0 +1,4 @@
+#include "wanderer.h"
+
+// Note : All implementation is in wanderer.h, but the Makefile
+//        needs a .cc file to know what .so files to make
@@ -0,0 +1,46 @@
+#ifndef __WANDERER_AGENT__H
+#define __WANDERER_AGENT__H 
+
+#include "enviro.h"
+
+using namespace enviro;
+
+class WandererController : public Process, public AgentInterface {
+
+    public:
+    WandererController() : Process(), AgentInterface(), turning(0), rate(2) {}
+
+    void init() {}
+    void start() {}
+    void update() {
+        if ( turning > 0 ) {
+            turning--;
+            track_velocity(0, rate);
+        } else if ( sensor_value(0) < 40 || sensor_value(1) < 25 || sensor_value(2) < 25 ) {
+            // Turn away from the nearer side for a while
+            turning = 3 + id() % 5;
+            rate = sensor_value(1) < sensor_value(2) ? -2 : 2;
+            track_velocity(0, rate);
+        } else {
+            track_velocity(4, 0);
+        }
+    }
+    void stop() {}
+
+    int turning;
+    double rate;
+
+};
+
+class Wanderer : public Agent {
+    public:
+    Wanderer(json spec, World& world) : Agent(spec, world) {
+        add_process(c);
+    }
+    private:
+    WandererController c;
+};
+
+DECLARE_INTERFACE(Wanderer)
+
+#endif
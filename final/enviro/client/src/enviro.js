@@ -9,7 +9,12 @@ const e = React.createElement;
 
 var CLIENT_ID;
 
-var HOST = window.location.href.substring(0, window.location.href.length - 1);
+var HOST = window.location.protocol + "//" + window.location.hostname;
+
+// A server running several worlds serves world n under /w/n. The client
+// shows the one named by ?world=n in its address, or the first.
+var WORLD = new URLSearchParams(window.location.search).get("world");
+var SERVER = HOST + ":8765" + ( WORLD ? "/w/" + encodeURIComponent(WORLD) : "" );
 
 var ZOOM = 1;
 var CX=0, CY=0;
@@ -59,7 +64,7 @@ class Sensor extends React.Component {
 function post_event(data) {
   let data_with_id = data;
   data_with_id.client_id = CLIENT_ID;
-  fetch(HOST+':8765/event', {
+  fetch(SERVER+'/event', {
     method: "POST", 
     mode: 'no-cors',
     headers: { 'Content-Type': 'application/json'},
@@ -68,6 +73,251 @@ function post_event(data) {
     .catch(error => { console.log("JSON parse error in post response: ", error) });  
 }
 
+// Decodes the binary frames pushed on the /stream WebSocket. Each frame is
+// either a keyframe or a delta against a frame this client acknowledged,
+// so recent decoded frames are kept to serve as baselines. The layout is
+// described in server/include/state_stream.h.
+const STREAM_FORMAT_VERSION = 2,
+      STREAM_KEYFRAME = 0x01,
+      STREAM_POSE = 0x01,
+      STREAM_VELOCITY = 0x02,
+      STREAM_SENSORS = 0x04,
+      STREAM_SPECIFICATION = 0x08,
+      STREAM_DECORATION = 0x10,
+      STREAM_LABEL = 0x20,
+      STREAM_HISTORY = 64;
+
+class StateStream {
+
+  constructor(on_state, on_close) {
+    this.frames = new Map();
+    this.on_state = on_state;
+    this.on_close = on_close;
+    this.decoder = new TextDecoder();
+    this.socket = new WebSocket(SERVER.replace(/^http/, "ws") + "/stream");
+    this.socket.binaryType = "arraybuffer";
+    this.socket.onmessage = msg => this.receive(msg.data);
+    this.socket.onclose = () => this.on_close();
+  }
+
+  ack(frame) {
+    let b = new ArrayBuffer(4);
+    new DataView(b).setUint32(0, frame, true);
+    this.socket.send(b);
+  }
+
+  receive(buffer) {
+
+    let view = new DataView(buffer),
+        pos = 0,
+        u8 = () => { pos += 1; return view.getUint8(pos-1); },
+        u32 = () => { pos += 4; return view.getUint32(pos-4, true); },
+        f32 = () => { pos += 4; return view.getFloat32(pos-4, true); },
+        str = () => {
+          let n = u32();
+          pos += n;
+          return this.decoder.decode(new Uint8Array(buffer, pos-n, n));
+        };
+
+    if ( u8() != STREAM_FORMAT_VERSION ) {
+      this.socket.close();
+      return;
+    }
+
+    let flags = u8(),
+        number = u32(),
+        baseline = u32(),
+        center = { x: f32(), y: f32() },
+        zoom = f32(),
+        timestamp = u32(),
+        interpolation = f32(),
+        num_updates = u32(),
+        num_removals = u32(),
+        agents;
+
+    if ( flags & STREAM_KEYFRAME ) {
+      agents = new Map();
+    } else if ( this.frames.has(baseline) ) {
+      agents = new Map(this.frames.get(baseline));
+    } else {
+      this.ack(0); // lost our baseline, ask for a keyframe
+      return;
+    }
+
+    for ( let i=0; i<num_updates; i++ ) {
+      let id = u32(),
+          mask = u8(),
+          a = Object.assign({ 
+            id: id, 
+            position: {}, 
+            velocity: {}, 
+            sensors: [], 
+            decoration: "", 
+            label: { text: "", x: 0, y: 0 } 
+          }, agents.get(id));
+      if ( mask & STREAM_POSE ) {
+        a.position = { x: f32(), y: f32(), theta: f32() };
+      }
+      if ( mask & STREAM_VELOCITY ) {
+        a.velocity = { x: f32(), y: f32(), theta: f32() };
+      }
+      if ( mask & STREAM_SENSORS ) {
+        let n = u8();
+        a.sensors = [];
+        for ( let j=0; j<n; j++ ) {
+          a.sensors.push(f32());
+        }
+      }
+      if ( mask & STREAM_SPECIFICATION ) {
+        a.specification = JSON.parse(str());
+      }
+      if ( mask & STREAM_DECORATION ) {
+        a.decoration = str();
+      }
+      if ( mask & STREAM_LABEL ) {
+        let x = f32(), y = f32();
+        a.label = { text: str(), x: x, y: y };
+      }
+      agents.set(id, a);
+    }
+
+    for ( let i=0; i<num_removals; i++ ) {
+      agents.delete(u32());
+    }
+
+    this.frames.set(number, agents);
+    for ( let n of this.frames.keys() ) {
+      if ( n + STREAM_HISTORY < number ) {
+        this.frames.delete(n);
+      }
+    }
+    this.ack(number);
+
+    this.on_state({
+      result: "ok",
+      timestamp: timestamp,
+      agents: Array.from(agents.values()),
+      center: center,
+      zoom: zoom,
+      interpolation: interpolation
+    });
+
+  }
+
+}
+
+// Decodes the binary frames served by /state?format=binary. Definitions
+// and styles come from a table that the server only sends the new entries
+// of, so the entries received so far are kept and reported back with each
+// request. The layout is described in server/include/state_encoder.h.
+const STATE_FORMAT_VERSION = 1,
+      STATE_QUANTIZED = 0x01;
+
+class StateDecoder {
+
+  constructor() {
+    this.table = 0;
+    this.entries = [];
+    this.decoder = new TextDecoder();
+  }
+
+  query() {
+    return `?format=binary&quantize=1&table=${this.table}&known=${this.entries.length}`;
+  }
+
+  // Returns the state, or null if the frame can not be used
+  decode(buffer) {
+
+    let view = new DataView(buffer),
+        pos = 0,
+        u8 = () => { pos += 1; return view.getUint8(pos-1); },
+        u16 = () => { pos += 2; return view.getUint16(pos-2, true); },
+        i16 = () => { pos += 2; return view.getInt16(pos-2, true); },
+        u32 = () => { pos += 4; return view.getUint32(pos-4, true); },
+        f32 = () => { pos += 4; return view.getFloat32(pos-4, true); },
+        str = () => {
+          let n = u32();
+          pos += n;
+          return this.decoder.decode(new Uint8Array(buffer, pos-n, n));
+        };
+
+    if ( u8() != STATE_FORMAT_VERSION ) {
+      return null;
+    }
+
+    let flags = u8(),
+        table = u32(),
+        number = u32(),
+        timestamp = u32(),
+        center = { x: f32(), y: f32() },
+        zoom = f32(),
+        interpolation = f32(),
+        quantized = flags & STATE_QUANTIZED,
+        q = quantized ? { x: f32(), y: f32(), position: f32(), velocity: f32(), omega: f32(), sensor: f32() } : null,
+        first = u32(),
+        num_entries = u32();
+
+    if ( table != this.table || first == 0 ) {
+      this.table = table;
+      this.entries = [];
+    }
+    if ( first != this.entries.length ) {
+      this.table = 0; // out of step, ask for the whole table
+      this.entries = [];
+      return null;
+    }
+    for ( let i=0; i<num_entries; i++ ) {
+      this.entries.push(JSON.parse(str()));
+    }
+
+    let agents = [], n = u32();
+    for ( let i=0; i<n; i++ ) {
+      let a = {
+        id: u32(),
+        specification: { definition: this.entries[u32()], style: this.entries[u32()] },
+        sensors: [],
+        decoration: "",
+        label: { text: "", x: 0, y: 0 }
+      };
+      if ( quantized ) {
+        a.position = { x: q.x + q.position * u16(), y: q.y + q.position * u16(), theta: u16() * 2 * Math.PI / 65536 };
+        a.velocity = { x: q.velocity * i16(), y: q.velocity * i16(), theta: q.omega * i16() };
+      } else {
+        a.position = { x: f32(), y: f32(), theta: f32() };
+        a.velocity = { x: f32(), y: f32(), theta: f32() };
+      }
+      agents.push(a);
+    }
+
+    for ( let a of agents ) {
+      let k = u8();
+      for ( let j=0; j<k; j++ ) {
+        a.sensors.push(quantized ? q.sensor * u16() : f32());
+      }
+    }
+
+    let num_labels = u32();
+    for ( let i=0; i<num_labels; i++ ) {
+      let a = agents[u32()],
+          x = f32(),
+          y = f32();
+      a.decoration = str();
+      a.label = { text: str(), x: x, y: y };
+    }
+
+    return {
+      result: "ok",
+      timestamp: timestamp,
+      agents: agents,
+      center: center,
+      zoom: zoom,
+      interpolation: interpolation
+    };
+
+  }
+
+}
+
 class Agent extends React.Component {
 
   findSize(el) {
@@ -118,6 +368,31 @@ class Agent extends React.Component {
 
 }
 
+// Statics never move, so the server sends them once, with the
+// configuration, which is fetched once, and they are only redrawn if a
+// new configuration arrives.
+class Statics extends React.Component {
+
+  shouldComponentUpdate(next) {
+    return next.statics !== this.props.statics;
+  }
+
+  render() {
+    let statics = this.props.statics || [];
+    return <g>
+      {statics.map((s, i) => <Agent key={"static-" + i} agent={{
+        id: s.id,
+        specification: { definition: { shape: s.shape }, style: s.style },
+        position: { x: 0, y: 0, theta: 0 },
+        sensors: [],
+        decoration: "",
+        label: { text: "", x: 0, y: 0 }
+      }} />)}
+    </g>
+  }
+
+}
+
 class Arena extends React.Component {
 
   findSize(el) {
@@ -168,6 +443,7 @@ class Arena extends React.Component {
                 onClick={e => this.click(e)}
                 ref={el => this.findSize(el)}>
       <g transform={center}>
+        <Statics statics={this.props.config.statics} />
         {this.props.data.agents.map(agent => <Agent agent={agent} key={agent.id} />)}
       </g>
     </svg>    
@@ -215,24 +491,61 @@ class Enviro extends React.Component {
       mode: "uninitialized",
       items: []
     };
+    this.decoder = new StateDecoder();
   }
 
   update() {
 
     if ( this.state.mode == "connecting" ) {
       this.get_configuration();
-    } else if ( this.state.mode == "connected" ) {
+    } else if ( this.state.mode == "connected" && !this.streaming ) {
       this.tick();
     }
 
   }
 
+  open_stream() {
+    if ( !window.WebSocket || this.stream ) {
+      return;
+    }
+    this.stream = new StateStream(
+      result => {
+        this.streaming = true;
+        this.receive(result);
+      },
+      () => {
+        // Fall back to polling /state until the next connection
+        let was_streaming = this.streaming;
+        this.stream = null;
+        this.streaming = false;
+        if ( was_streaming ) {
+          this.update();
+        }
+      }
+    );
+  }
+
+  receive(result) {
+    this.setState({
+      mode: "connected",
+      data: result,
+      error: false
+    });
+    if ( !CENTER_DEF ) {
+      CX = window.innerWidth/(2*result.zoom) - result.center.x;
+      CY = (window.innerWidth/2 - 41)/result.zoom - result.center.x;
+      CENTER_DEF = true;
+    }
+    ZOOM = result.zoom;
+  }
+
   get_configuration() {
-    fetch(HOST+":8765/config/"+CLIENT_ID)
+    fetch(SERVER+"/config/"+CLIENT_ID)
       .then(res => res.json())
       .then(
         res => {
           this.setState({ mode: "connected", config: res.config }, () => {
+            this.open_stream();
             setTimeout(() => { this.update() } , 25);
           });
         },
@@ -245,24 +558,27 @@ class Enviro extends React.Component {
       )
   }
 
+  // The part of the world on screen, as left,bottom,right,top in world
+  // coordinates, so the server can leave out agents that are not in view.
+  viewport() {
+    if ( !CENTER_DEF ) {
+      return "";
+    }
+    let w = window.innerWidth,
+        h = window.innerHeight-41;
+    return `&view=${-CX},${-CY},${w/ZOOM-CX},${h/ZOOM-CY}`;
+  }
+
   tick() {
-    fetch(HOST+":8765/state/"+CLIENT_ID)
-      .then(res => res.json())
+    fetch(SERVER+"/state/"+CLIENT_ID+this.decoder.query()+this.viewport())
+      .then(res => res.arrayBuffer())
       .then(
-        (result) => {
-          this.setState({
-            mode: "connected",
-            data: result,
-            error: false
-          }, () => {
-            setTimeout(() => { this.update() } , 25);
-          });
-          if ( !CENTER_DEF ) {
-            CX = window.innerWidth/(2*result.zoom) - result.center.x;
-            CY = (window.innerWidth/2 - 41)/result.zoom - result.center.x;
-            CENTER_DEF = true;
+        (buffer) => {
+          let result = this.decoder.decode(buffer);
+          if ( result && !this.streaming ) {
+            this.receive(result);
           }
-          ZOOM = result.zoom;
+          setTimeout(() => { this.update() } , 25);
         },
         (error) => {
           this.setState({
@@ -321,7 +637,7 @@ class Enviro extends React.Component {
       return (
         <div>
           <Taskbar name={config.name} data={data} buttons={config.buttons} />
-          <Arena w={w} h={h} data={data} />
+          <Arena w={w} h={h} data={data} config={config} />
         </div>      
       );
     }
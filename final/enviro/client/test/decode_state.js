@@ -0,0 +1,31 @@
+// Decodes /state?format=binary responses with the client's own
+// StateDecoder, for the server's tests.
+//
+//   node decode_state.js FILE ...
+//
+// The files are decoded in order by one decoder, as successive responses
+// to one client, and the results are printed as a json array. The decoder
+// is taken from src/enviro.js, which is otherwise JSX for the browser.
+
+const fs = require("fs"),
+      path = require("path");
+
+let source = fs.readFileSync(path.join(__dirname, "../src/enviro.js"), "utf8"),
+    start = source.indexOf("const STATE_FORMAT_VERSION"),
+    end = source.indexOf("\n}\n", source.indexOf("class StateDecoder", start));
+
+if ( start < 0 || end < 0 ) {
+  console.error("Could not find StateDecoder in src/enviro.js");
+  process.exit(1);
+}
+
+let StateDecoder = new Function(source.slice(start, end + 2) + "\nreturn StateDecoder;")(),
+    decoder = new StateDecoder(),
+    results = process.argv.slice(2).map(file => {
+      let bytes = fs.readFileSync(file),
+          buffer = bytes.buffer.slice(bytes.byteOffset, bytes.byteOffset + bytes.length),
+          state = decoder.decode(buffer);
+      return { state: state, query: decoder.query() };
+    });
+
+console.log(JSON.stringify(results));
@@ -1,19 +1,59 @@
 #ifndef __ENVIRO_AGENT__H
 #define __ENVIRO_AGENT__H 
 
+#include <atomic>
 #include <iostream>
 #include <chrono>
+#include <new>
+#include <future>
+#include <mutex>
 #include "elma/elma.h"
 #include "chipmunk.h"
 #include "enviro.h"
 #include "sensor.h"
+#include "state_stream.h"
+#include "agent_registry.h"
 
 #define DBG std::cout << __FILE__ << ":" << __LINE__ << "\n";
 
 #define AGENT_CREATE_TYPE (Agent* (*)(json spec, World&))
 #define AGENT_DESTROY_TYPE (void (*)(Agent*))
+#define AGENT_SIZE_TYPE (size_t (*)())
+#define AGENT_CONSTRUCT_TYPE (Agent* (*)(void *, json spec, World&))
 
-#define AGENT_COLLISION_TYPE 1
+#define AGENT_COLLISION_TYPE 1 // collision type of the first interned agent type
+#define AGENT_SENSOR_CATEGORY 1 // shape filter category seen by range sensors
+
+#ifdef ENVIRO_STATIC_AGENTS
+
+// Compiled into the enviro executable: registers the type under the
+// controller path its definition names, which the build passes in as
+// ENVIRO_CONTROLLER
+#ifndef ENVIRO_CONTROLLER
+#error "ENVIRO_STATIC_AGENTS needs ENVIRO_CONTROLLER, e.g. -DENVIRO_CONTROLLER='\"lib/wanderer.so\"'"
+#endif
+
+#define DECLARE_INTERFACE(__CLASS_NAME__)                                         \
+static bool __enviro_registered_##__CLASS_NAME__ =                               \
+    enviro::AgentRegistry::add(ENVIRO_CONTROLLER, {                               \
+        [](json spec, enviro::World& world) -> enviro::Agent* {                   \
+            return new __CLASS_NAME__(spec, world);                               \
+        },                                                                        \
+        [](enviro::Agent* object) {                                               \
+            delete static_cast<__CLASS_NAME__*>(object);                          \
+        },                                                                        \
+        []() -> size_t {                                                          \
+            return sizeof(__CLASS_NAME__);                                        \
+        },                                                                        \
+        [](void * memory, json spec, enviro::World& world) -> enviro::Agent* {    \
+            return new (memory) __CLASS_NAME__(spec, world);                      \
+        },                                                                        \
+        [](enviro::Agent* object) {                                               \
+            static_cast<__CLASS_NAME__*>(object)->~__CLASS_NAME__();              \
+        }                                                                         \
+    });
+
+#else
 
 #define DECLARE_INTERFACE(__CLASS_NAME__)                                         \
 extern "C" __CLASS_NAME__* create_agent(json spec, enviro::World& world) {        \
@@ -21,8 +61,20 @@ extern "C" __CLASS_NAME__* create_agent(json spec, enviro::World& world) {
 }                                                                                 \
 extern "C" void destroy_agent( __CLASS_NAME__* object ) {                         \
     delete object;                                                                \
+}                                                                                 \
+extern "C" size_t agent_size() {                                                  \
+    return sizeof(__CLASS_NAME__);                                                \
+}                                                                                 \
+extern "C" __CLASS_NAME__* construct_agent(void * memory, json spec,              \
+                                           enviro::World& world) {                \
+    return new (memory) __CLASS_NAME__(spec, world);                              \
+}                                                                                 \
+extern "C" void destruct_agent( __CLASS_NAME__* object ) {                        \
+    object->~__CLASS_NAME__();                                                    \
 }
 
+#endif
+
 using namespace std::chrono;
 using namespace elma;
 using nlohmann::json; 
@@ -30,9 +82,50 @@ using nlohmann::json;
 namespace enviro {
 
     class World;
+    struct AGENT_TYPE;
     class Controller;
     class AgentInterface;
 
+    typedef enum { AGENT_DYNAMIC, AGENT_STATIC, AGENT_NONINTERACTIVE, AGENT_INVISIBLE } AGENT_KIND;
+    typedef enum { AGENT_SHAPE_NONE, AGENT_SHAPE_POLYGON, AGENT_SHAPE_OMNI } AGENT_SHAPE_KIND;
+
+    typedef enum { COMMAND_FORCE, COMMAND_TELEPORT, COMMAND_MOMENT } ACTUATOR_COMMAND_TYPE;
+
+    //! An actuator write recorded while controllers run in parallel. The
+    //! world applies recorded commands, in order, once every controller has
+    //! finished, so that no body changes while others are being sensed.
+    typedef struct {
+        ACTUATOR_COMMAND_TYPE type;
+        cpVect v;      // force or position
+        cpFloat a;     // torque, angle or moment
+    } ACTUATOR_COMMAND;
+
+    //! What a collision handler is told about the other agent. Passed
+    //! instead of an Event when the handler takes one of these.
+    typedef struct {
+        int id;          // the other agent's id
+        int type;        // its interned type id, see World::intern_type
+        double x, y;     // its position
+    } COLLISION;
+
+    //! Either kind of handler registered with notice_collisions_with.
+    typedef struct {
+        std::function<void(Event&)> event;
+        std::function<void(const COLLISION&)> record;
+    } COLLISION_HANDLER;
+
+    //! Physical parameters decoded once from an agent's json definition,
+    //! so that actuators and getters never touch json while updating.
+    typedef struct {
+        AGENT_KIND kind;
+        AGENT_SHAPE_KIND shape;
+        cpFloat mass;
+        cpFloat radius;
+        cpFloat collision_friction;
+        cpFloat linear_friction;
+        cpFloat rotational_friction;
+    } AGENT_PARAMETERS;
+
     class Agent : public Process {
 
         friend class World;
@@ -43,6 +136,9 @@ namespace enviro {
         Agent& add_process(Process &p);
         Agent& add_process(StateMachine &m);
         json serialize();
+        AGENT_RECORD record();
+        std::shared_ptr<const std::string> specification_text();
+        json full_specification() const;
         inline void set_destroyer(void (*f)(Agent*)) { _destroyer = f; }     
         ~Agent();
 
@@ -76,20 +172,28 @@ namespace enviro {
         Agent& teleport(cpFloat x, cpFloat y, cpFloat theta);
 
         // Parameter getters
-        inline json definition() const { return  _specification["definition"]; }
-        inline json friction() const { return definition()["friction"]; }
-        inline double linear_friction() const { return friction()["linear"].get<cpFloat>(); }
-        inline double rotational_friction() const { return friction()["rotational"].get<cpFloat>(); }
-        inline bool is_static() const { return _specification["definition"]["type"] == "static"; }
+        inline const json& definition() const { return *_definition; }
+        inline json friction() const { return definition().value("friction", json()); }
+        inline const AGENT_PARAMETERS& parameters() const { return _params; }
+        inline double mass() const { return _params.mass; }
+        inline double linear_friction() const { return _params.linear_friction; }
+        inline double rotational_friction() const { return _params.rotational_friction; }
+        inline bool is_static() const { return _params.kind == AGENT_STATIC; }
 
         // Sensor methods
         double sensor_value(int index);
         std::string sensor_reflection_type(int index);
         std::vector<double> sensor_values();
         std::vector<std::string> sensor_reflection_types();
+        int sensor_reflection_type_id(int index);
+
+        //! Every sensor's reading, computed at most once per physics step
+        //! and shared by the controller, the state snapshots and serialize().
+        const std::vector<SENSOR_READING>& sensor_readings();
 
         // Collisons
         Agent& notice_collisions_with(const std::string agent_type, std::function<void(Event&)> handler);
+        Agent& notice_collisions_with(const std::string agent_type, std::function<void(const COLLISION&)> handler);
         Agent& ignore_collisions_with(const std::string agent_type);   
         Agent& handle_collision(const Agent &other);     
 
@@ -102,6 +206,8 @@ namespace enviro {
         inline World * get_world_ptr() { return _world_ptr; }
         inline cpShape * get_shape() { return _shape; } 
         inline int get_id() const { return _id; }  
+        inline int get_type_id() const { return _type_id; }
+        inline cpGroup get_shape_group() const { return (cpGroup) _id + 1; }
 
         // Styles
         Agent& set_style(json style); 
@@ -122,10 +228,11 @@ namespace enviro {
         Agent& find_agent(int id);
         void remove_agent(int id);
         bool agent_exists(int id);
+        Agent * lookup_agent(int id);
         inline void mark_for_removal() { _alive = false; }
         inline bool is_alive() { return _alive; }
         Agent& add_agent(const std::string name, double x, double y, double theta, const json style);
-        inline bool visible() const { return !_invisible; }
+        inline bool visible() const { return _params.kind != AGENT_INVISIBLE; }
         Agent& set_client_id(std::string str);
         std::string get_client_id();
 
@@ -134,16 +241,32 @@ namespace enviro {
         cpShape * _shape;
         void (* _destroyer)(Agent*);
         int _id;
-        json _specification;
+        json _specification;                   // without the definition
+        std::shared_ptr<const json> _definition;
+        std::shared_ptr<const std::string> _definition_text;
+        AGENT_TYPE * _type;                    // NULL for static objects
+        bool _pooled;                          // built in the type's storage
+        AGENT_PARAMETERS _params;
         std::vector<Process *> _processes;
         std::vector<Sensor *> _sensors;
+        std::vector<SENSOR_READING> _readings;
+        unsigned long _readings_step;          // world step they were read at
         World * _world_ptr;
         void setup_sensors();
-        map<string, std::function<void(Event&)>> collision_handlers;
-        bool _alive;
+        void actuate(const ACTUATOR_COMMAND& command);
+        void execute(const ACTUATOR_COMMAND& command);
+        void apply_commands();
+        void enter_space();
+        void watch_collisions(const std::string& agent_type, COLLISION_HANDLER handler);
+        map<int, COLLISION_HANDLER> collision_handlers; // keyed by type id
+        int _type_id;
+        std::atomic<bool> _alive;              // cleared by remove_agent from any controller thread
         double _moment_of_inertia;
-        bool _invisible;
         std::string _client_id;
+        std::shared_ptr<const std::string> _specification_text;
+        std::shared_ptr<const std::string> _style_text;
+        bool _deferred;
+        std::vector<ACTUATOR_COMMAND> _commands;
 
         // Decorations
         std::string _decoration;
@@ -157,6 +280,22 @@ namespace enviro {
         //! in the defs directory.
         static json build_specification(json agent_entry);
 
+        //! Reads and checks the definition file at path. Each file is 
+        //! parsed and validated once, and again only if its modification
+        //! time changes. Safe to call from several threads.
+        static std::shared_ptr<const json> load_definition(const std::string& path);
+
+        //! Loads the distinct definition files named by a list of agent
+        //! entries in parallel, so that build_specification finds them
+        //! already parsed.
+        static void preload_definitions(const std::vector<json>& entries);
+
+        //! Reads the vertices of a polygon shaped definition.
+        static std::vector<cpVect> bake_vertices(const json& definition);
+
+        //! Decodes the typed parameter block from a definition json.
+        static AGENT_PARAMETERS decode_parameters(const json& definition);
+
     };
 
 }
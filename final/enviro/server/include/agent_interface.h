@@ -45,9 +45,11 @@ namespace enviro {
         std::vector<double> sensor_values();
         std::string sensor_reflection_type(int index);
         std::vector<std::string> sensor_reflection_types();
+        int sensor_reflection_type_id(int index);
 
         // Collisons
         void notice_collisions_with(const std::string agent_type, std::function<void(Event&)> handler);
+        void notice_collisions_with(const std::string agent_type, std::function<void(const COLLISION&)> handler);
         void ignore_collisions_with(const std::string agent_type);
 
         // Constraints
@@ -55,9 +57,13 @@ namespace enviro {
         void prevent_rotation();
         void allow_rotation();
 
-        // Agent management
+        // Agent management. Statics from the configuration have ids and can be
+        // found, and sensors and collisions report them as "StaticObject",
+        // but they are not in the world's agent list, so World::all does not
+        // visit them.
         Agent& find_agent(int id);
         bool agent_exists(int id);
+        Agent * lookup_agent(int id);
         void remove_agent(int id);
         Agent& add_agent(const std::string name, double x, double y, double theta, const json style);
         void set_client_id(std::string str);
@@ -0,0 +1,49 @@
+#ifndef __ENVIRO_AGENT_REGISTRY__H
+#define __ENVIRO_AGENT_REGISTRY__H
+
+#include <map>
+#include <string>
+#include "json/json.h"
+
+using nlohmann::json;
+
+namespace enviro {
+
+    class Agent;
+    class World;
+
+    //! The functions DECLARE_INTERFACE defines for an agent type.
+    typedef struct {
+        Agent* (*create_agent)(json spec, World&);
+        void (*destroy_agent)(Agent*);
+        size_t (*agent_size)();
+        Agent* (*construct_agent)(void * memory, json spec, World&);
+        void (*destruct_agent)(Agent*);
+    } AGENT_FACTORY;
+
+    //! Agent types compiled into the enviro executable rather than loaded
+    //! from shared objects. Agent sources built with ENVIRO_STATIC_AGENTS
+    //! defined add themselves when the program starts, under the controller
+    //! path their definitions name (for example "lib/wanderer.so"), and
+    //! World uses them in place of dlopen. See static.mk.
+    class AgentRegistry {
+
+        public:
+
+        //! Registers a type. Returns true, so it can initialize a static.
+        static bool add(const std::string& controller, AGENT_FACTORY factory);
+
+        //! The type registered for a controller path, or NULL.
+        static const AGENT_FACTORY * find(const std::string& controller);
+
+        private:
+
+        // Constructed on first use, since types register during static 
+        // initialization
+        static std::map<std::string, AGENT_FACTORY>& types();
+
+    };
+
+}
+
+#endif
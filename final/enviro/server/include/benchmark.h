@@ -0,0 +1,66 @@
+#ifndef __ENVIRO_BENCHMARK__H
+#define __ENVIRO_BENCHMARK__H
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include "enviro.h"
+#include "state_encoder.h"
+
+namespace enviro {
+
+    //! A process that measures a headless run for the benchmark suite in
+    //! bench/. Each update it captures the world's state and serializes it
+    //! the way the server would, as json for /state, as a binary 
+    //! keyframe for /stream and as /state?format=binary, compact and
+    //! quantized, for a client that already holds the string table, timing
+    //! each part. When the manager stops, it
+    //! appends one json line to its file with the world's profile, the
+    //! serialization costs and payload sizes, the time it took to build
+    //! the world, and the config's "bench" object, which identifies the run.
+    //!
+    //! Readers, if any, are threads that stand in for viewers. From start
+    //! to stop each one reads the world's snapshot and writes it as json
+    //! in a loop, so the report shows how snapshots and the contention
+    //! for them change the world's update times.
+    class Benchmark : public Process {
+
+        public:
+
+        //! Startup is the time, in seconds, the world took to build,
+        //! including loading its agent types.
+        Benchmark(World& world, std::string filename, json label, int readers = 0, double startup = 0);
+        ~Benchmark();
+
+        void init() {}
+        void start();
+        void update();
+        void stop();
+
+        private:
+
+        World& world;
+        std::ofstream out;
+        json label;
+        long long start_time;
+        double startup;
+
+        // Per sample, in nanoseconds, and the latest payload sizes
+        std::vector<long long> capture_ns, json_ns, binary_ns, compact_ns, quantized_ns;
+        size_t json_bytes, binary_bytes, compact_bytes, quantized_bytes, agents;
+
+        StateEncoder encoder;
+
+        void stop_readers();
+        int readers;
+        std::vector<std::thread> reader_threads;
+        std::atomic<bool> reading;
+        std::atomic<unsigned long long> reads;
+        long long reading_ns;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef __ENVIRO_BYTES__H
+#define __ENVIRO_BYTES__H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+
+// Little-endian encoding helpers shared by the binary state formats and
+// the record log.
+
+namespace enviro {
+
+    inline void put_u8(std::string& out, uint8_t v) {
+        out.push_back((char) v);
+    }
+
+    inline void put_u16(std::string& out, uint16_t v) {
+        out.push_back((char) (v & 0xff));
+        out.push_back((char) (v >> 8));
+    }
+
+    inline void put_u32(std::string& out, uint32_t v) {
+        for ( int i=0; i<4; i++ ) {
+            out.push_back((char) ((v >> (8*i)) & 0xff));
+        }
+    }
+
+    inline void put_f32(std::string& out, float f) {
+        uint32_t v;
+        memcpy(&v, &f, sizeof(v));
+        put_u32(out, v);
+    }
+
+    inline void put_f64(std::string& out, double f) {
+        uint64_t v;
+        memcpy(&v, &f, sizeof(v));
+        put_u32(out, (uint32_t) v);
+        put_u32(out, (uint32_t) (v >> 32));
+    }
+
+    inline void put_string(std::string& out, const std::string& s) {
+        put_u32(out, s.size());
+        out.append(s);
+    }
+
+    //! Reads values written with the put_ functions from a buffer, and
+    //! throws std::runtime_error rather than reading past its end.
+    class ByteReader {
+
+        public:
+
+        ByteReader(const unsigned char * data, size_t size) : _data(data), _size(size), _pos(0) {}
+
+        inline uint8_t u8() {
+            need(1);
+            return _data[_pos++];
+        }
+
+        inline uint32_t u32() {
+            need(4);
+            uint32_t v = _data[_pos] | ( _data[_pos+1] << 8 ) | ( _data[_pos+2] << 16 ) | ( (uint32_t) _data[_pos+3] << 24 );
+            _pos += 4;
+            return v;
+        }
+
+        inline float f32() {
+            uint32_t v = u32();
+            float f;
+            memcpy(&f, &v, sizeof(f));
+            return f;
+        }
+
+        inline double f64() {
+            uint64_t lo = u32(), hi = u32();
+            uint64_t v = lo | ( hi << 32 );
+            double f;
+            memcpy(&f, &v, sizeof(f));
+            return f;
+        }
+
+        inline const unsigned char * bytes(size_t n) {
+            need(n);
+            _pos += n;
+            return _data + _pos - n;
+        }
+
+        inline size_t position() const { return _pos; }
+        inline bool done() const { return _pos >= _size; }
+
+        private:
+
+        inline void need(size_t n) {
+            if ( _size - _pos < n ) {
+                throw std::runtime_error("Unexpected end of binary data");
+            }
+        }
+
+        const unsigned char * _data;
+        size_t _size, _pos;
+
+    };
+
+}
+
+#endif
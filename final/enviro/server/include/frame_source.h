@@ -0,0 +1,38 @@
+#ifndef __ENVIRO_FRAME_SOURCE__H
+#define __ENVIRO_FRAME_SOURCE__H
+
+#include <memory>
+#include <string>
+#include "elma/elma.h"
+#include "json/json.h"
+#include "state_stream.h"
+
+namespace enviro {
+
+    using nlohmann::json;
+
+    //! What a WorldServer serves: frames for viewers, the configuration
+    //! sent to clients, and somewhere for client events to go. Implemented
+    //! by World for live runs and by Replay for recorded ones.
+    class FrameSource {
+
+        public:
+
+        virtual ~FrameSource() {}
+
+        //! The newest frame. Called from the server thread.
+        virtual std::shared_ptr<const WORLD_FRAME> snapshot() = 0;
+
+        virtual json get_config() const = 0;
+
+        //! Called from the server thread with the manager mutex held.
+        virtual void handle_event(const elma::Event& e) = 0;
+
+        //! Prometheus text for GET /metrics.
+        virtual std::string metrics() = 0;
+
+    };
+
+}
+
+#endif
@@ -1,15 +1,54 @@
 #ifndef __ENVIRO_JSON_HELPER__H
 #define __ENVIRO_JSON_HELPER__H
 
+#include <string>
+#include <utility>
+#include <vector>
 #include "json/json.h"
 
 using nlohmann::json;
 
 namespace json_helper {
 
+    //! A schema compiled into a flat tree of nodes, so that documents can
+    //! be checked against it many times without walking or copying json.
+    //!
+    //! Schemas are example documents. A null, boolean, number or string
+    //! requires a value of the same kind, an array of one element requires
+    //! an array each of whose elements matches that element, and an object
+    //! requires at least its keys, each with a matching value.
+    class Schema {
+
+        public:
+
+        Schema(const json& schema);
+
+        //! Throws std::runtime_error naming the JSON pointer of the first
+        //! part of object that does not match.
+        void check(const json& object) const;
+
+        private:
+
+        enum Kind { NULL_VALUE, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT, ANYTHING };
+
+        typedef struct {
+            Kind kind;
+            int element;                                    // ARRAY
+            std::vector<std::pair<std::string, int>> keys;  // OBJECT
+        } NODE;
+
+        int compile(const json& schema);
+        void check(const json& object, int node, std::string& pointer) const;
+
+        std::vector<NODE> _nodes;   // the root is _nodes[0]
+
+    };
+
     json read(std::string filename);
-    bool check(json object, json schema);
+
+    //! Checks object against a schema, as Schema does.
+    void check(const json& object, const json& schema);
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,114 @@
+#ifndef __ENVIRO_PROFILER__H
+#define __ENVIRO_PROFILER__H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "json/json.h"
+
+using nlohmann::json;
+
+#define PROFILE_WINDOW 1024 // most recent world updates kept for percentiles
+#define PROFILE_BUCKETS 24   // histogram buckets for whole updates, 1us to 4s
+
+namespace enviro {
+
+    //! The timed parts of a world update. PHASE_UPDATE is the whole update.
+    typedef enum {
+        PHASE_CONSTRAINTS,
+        PHASE_GARBAGE,
+        PHASE_REMOVALS,
+        PHASE_NEW_AGENTS,
+        PHASE_CONTROLLERS,
+        PHASE_STEP,
+        PHASE_SNAPSHOT,
+        PHASE_UPDATE,
+        NUM_PHASES
+    } PHASE;
+
+    //! Work done outside world updates, or spread over many agents, that
+    //! is only totalled.
+    typedef enum {
+        WORK_CONTROLLER,
+        WORK_SENSOR,
+        NUM_WORK_KINDS
+    } WORK_KIND;
+
+    //! The durations of the phases of one world update, in nanoseconds.
+    //! The world thread fills one in and commits it when the update ends.
+    class PhaseTimer {
+
+        public:
+
+        PhaseTimer() : _durations{}, _last(std::chrono::steady_clock::now()), _start(_last) {}
+
+        //! Charges the time since the previous mark to the given phase.
+        inline void mark(PHASE phase) {
+            auto now = std::chrono::steady_clock::now();
+            _durations[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(now - _last).count();
+            _last = now;
+        }
+
+        //! Charges the time since the timer was made to PHASE_UPDATE.
+        inline void finish() {
+            _durations[PHASE_UPDATE] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - _start).count();
+        }
+
+        inline long long duration(PHASE phase) const { return _durations[phase]; }
+
+        private:
+
+        long long _durations[NUM_PHASES];
+        std::chrono::steady_clock::time_point _last, _start;
+
+    };
+
+    //! Keeps rolling windows of phase durations, running totals and a few
+    //! gauges describing the world, and writes them in the Prometheus text
+    //! exposition format. Committing takes one short lock per world update.
+    //! Totals of work done by agents are atomic, so they can be added to
+    //! from controller threads.
+    class Profiler {
+
+        public:
+
+        Profiler();
+
+        void commit(const PhaseTimer& timer, int agents, int shapes, unsigned long steps);
+
+        inline void add_work(WORK_KIND kind, long long nanoseconds) {
+            _work_time[kind] += nanoseconds;
+            _work_count[kind]++;
+        }
+
+        //! Returns the metrics as a Prometheus text document.
+        std::string prometheus();
+
+        //! Returns the same figures as a json object, in seconds, for
+        //! benchmark reports.
+        json report();
+
+        private:
+
+        double quantile(int phase, int n, double q, std::vector<long long>& window);
+
+        std::mutex _mutex;
+        long long _window[NUM_PHASES][PROFILE_WINDOW];
+        int _next;
+        unsigned long long _count;
+        long long _sum[NUM_PHASES];
+        unsigned long long _histogram[PROFILE_BUCKETS]; // updates under 2^b us, the last unbounded
+        int _agents, _shapes;
+        unsigned long _steps;
+
+        std::atomic<long long> _work_time[NUM_WORK_KINDS];
+        std::atomic<unsigned long long> _work_count[NUM_WORK_KINDS];
+
+    };
+
+}
+
+#endif
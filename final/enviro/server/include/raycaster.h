@@ -0,0 +1,119 @@
+#ifndef __ENVIRO_RAYCASTER__H
+#define __ENVIRO_RAYCASTER__H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "chipmunk.h"
+
+// Kernels used by a Raycaster
+#define RAYCAST_CHIPMUNK 0  // not used: sensors query the space directly
+#define RAYCAST_SCALAR   1
+#define RAYCAST_AVX2     2
+
+namespace enviro {
+
+    //! The nearest shape along a ray.
+    typedef struct {
+        double alpha;       // fraction of the way from start to end
+        cpVect point;
+        int type;           // agent type id of the shape's owner
+    } RAYCAST_HIT;
+
+    //! Answers range sensor queries from a flat copy of the shapes in a
+    //! space, taken once per physics step. Circle centres and radii and
+    //! polygon vertices and edge normals are kept in separate arrays,
+    //! bucketed by a uniform grid, so each cell a ray passes through is
+    //! tested with a few straight loops instead of a walk of Chipmunk's
+    //! bounding box tree. The loops run four shapes or edges at a time
+    //! with AVX2 when the processor has it.
+    //!
+    //! The tests repeat Chipmunk's segment queries operation for
+    //! operation, from the same cached shape transforms, so a cast returns
+    //! the same hit as cpSpaceSegmentQueryFirst with a zero radius and the
+    //! sensor filter. When two shapes are hit at exactly the same alpha,
+    //! the static one, then the one added first, wins.
+    //!
+    //! The copy is refreshed lazily, by the first cast after the world
+    //! steps or adds or removes a shape. Teleporting a body moves it
+    //! without updating its shape, so until the next step casts report
+    //! that they can not be answered and sensors fall back to the space.
+    class Raycaster {
+
+        public:
+
+        Raycaster();
+
+        //! Sets the space to copy and the kernel to use. Mode is "auto"
+        //! (AVX2 if available), "scalar" or "chipmunk" (disabled). Cell
+        //! size is the width of the grid's cells in world units.
+        void configure(cpSpace * space, const std::string& mode, double cell_size);
+
+        //! Called by the world after each physics step.
+        inline void stepped() { _moved = false; _fresh = false; }
+
+        //! Called when a shape is added to or removed from the space.
+        inline void shapes_changed() { _fresh = false; }
+
+        //! Called when a body is teleported.
+        inline void moved() { _moved = true; }
+
+        //! Whether cast can be used now.
+        inline bool usable() const { return _kernel != RAYCAST_CHIPMUNK && !_moved; }
+
+        inline int kernel() const { return _kernel; }
+
+        //! Finds the nearest shape on the segment from start to end that is
+        //! seen by range sensors and not in the given group. Returns false
+        //! if nothing is hit. Safe to call from several threads at once, as
+        //! long as nobody changes the space meanwhile.
+        bool cast(cpVect start, cpVect end, cpGroup group, RAYCAST_HIT& hit);
+
+        private:
+
+        typedef struct {
+            bool circle;
+            bool is_static;
+            cpGroup group;
+            int type;
+            int first, count;   // polygon: vertex and edge range
+            double x, y, r;     // circle: centre; both: radius
+            cpBB bb;
+        } SHAPE;
+
+        void refresh();
+        void add_shape(cpShape * shape);
+        void build_grid();
+
+        cpSpace * _space;
+        int _kernel;
+        double _cell_size;
+
+        std::atomic<bool> _fresh, _moved;
+        std::mutex _mutex;
+
+        // Shapes, statics first, and polygon data. Vertex i of a polygon
+        // is (_vx[i], _vy[i]), and the edge to it from the previous vertex,
+        // (_px[i], _py[i]), has normal (_nx[i], _ny[i]). Each polygon's
+        // range is padded to a multiple of four.
+        std::vector<SHAPE> _shapes;
+        std::vector<double> _vx, _vy, _px, _py, _nx, _ny;
+
+        // The grid, with each cell's circles and polygons listed from
+        // _circle_start[c] and _polygon_start[c]. Circle data is copied
+        // into every cell the circle overlaps, so cells can be scanned
+        // without indirection.
+        double _x0, _y0, _cell;
+        int _columns, _rows;
+        std::vector<int> _circle_start, _polygon_start;
+        std::vector<double> _cx, _cy, _cr;
+        std::vector<int64_t> _cgroup;
+        std::vector<int> _circle_shape, _polygon_shape;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef __ENVIRO_RECORDER__H
+#define __ENVIRO_RECORDER__H
+
+#include <stdio.h>
+#include <map>
+#include <unordered_map>
+#include "enviro.h"
+
+#define RECORD_MAGIC "ENVIROLG"
+#define RECORD_VERSION 1
+
+// Entry kinds
+#define RECORD_STRING 1
+#define RECORD_FRAME  2
+
+namespace enviro {
+
+    //! Writes frames to a binary log for Replay to play back.
+    //!
+    //! Layout (all little-endian, no padding):
+    //!
+    //!   8 bytes "ENVIROLG", u32 version, then entries of
+    //!   u8 kind, u32 payload size, payload
+    //!
+    //!   RECORD_STRING: u32 index, then the string's bytes. Adds a string to
+    //!     the log's table. Agent specifications (type definition and
+    //!     style), decorations and labels are all written once, before the
+    //!     first frame that refers to them, and referred to by index.
+    //!
+    //!   RECORD_FRAME: f64 time (ms since the run started), u32 unix time,
+    //!     f32 center x, f32 center y, f32 zoom, u32 number of agents, then
+    //!     for each agent: u32 id, u32 specification, f32 x, y, theta,
+    //!     f32 vx, vy, omega, u32 decoration, u32 label, f32 label x,
+    //!     f32 label y, u8 number of sensors, f32 per sensor.
+    //!
+    //! Statics are not in frames. Replay takes them from its configuration.
+    class RecordWriter {
+
+        public:
+
+        RecordWriter(std::string filename);
+        ~RecordWriter();
+
+        //! Appends a frame recorded at the given time, in ms, after any
+        //! strings it uses that the log does not have yet.
+        void write(const WORLD_FRAME& frame, double time);
+        void flush();
+
+        private:
+
+        uint32_t intern(const std::string& s);
+        uint32_t intern(const std::shared_ptr<const std::string>& s);
+        void write(uint8_t kind, const std::string& payload);
+
+        FILE * out;
+        std::string entry;
+        std::unordered_map<std::string, uint32_t> strings;
+        std::map<std::shared_ptr<const std::string>, uint32_t> shared_strings;
+
+    };
+
+    //! A process that appends the world's state to a log, once per update.
+    class Recorder : public Process {
+
+        public:
+
+        Recorder(World& world, std::string filename);
+
+        void init() {}
+        void start() {}
+        void update();
+        void stop();
+
+        private:
+
+        World& world;
+        RecordWriter writer;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef __ENVIRO_REPLAY__H
+#define __ENVIRO_REPLAY__H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "enviro.h"
+#include "frame_source.h"
+
+namespace enviro {
+
+    //! Plays back a log written by Recorder, without physics or controllers.
+    //! The log is memory mapped and indexed once. Frames are decoded when
+    //! the clock reaches them, at any speed and from any position.
+    //!
+    //! Clients control playback by posting "replay" events to /event, with
+    //! optional "speed" (1 is real time, 0 pauses) and "seek" (seconds from
+    //! the start of the recording) fields.
+    class Replay : public FrameSource {
+
+        public:
+
+        Replay(std::string filename, json config, double speed=1, double seek=0);
+        ~Replay();
+
+        std::shared_ptr<const WORLD_FRAME> snapshot();
+        inline json get_config() const { return config; }
+        void handle_event(const Event& e);
+        std::string metrics();
+
+        //! Seconds from the first frame to the last.
+        double length() const;
+
+        private:
+
+        double position();
+        void set_playback(double speed, double seek);
+        std::shared_ptr<const WORLD_FRAME> decode(int index);
+
+        typedef std::pair<std::shared_ptr<const std::string>, std::shared_ptr<const std::string>> SPECIFICATION_PARTS;
+        const SPECIFICATION_PARTS& split(uint32_t k);
+
+        json config;
+        const unsigned char * data;
+        size_t size;
+
+        std::vector<std::shared_ptr<const std::string>> strings;
+        std::map<uint32_t, SPECIFICATION_PARTS> parts; // definition and style, by string
+        std::vector<size_t> frames;     // offset of each frame's payload
+        std::vector<size_t> lengths;    // and its size
+        std::vector<double> times;      // ms since the start of the recording
+
+        double speed;
+        double origin;                  // position, in ms, at start_time
+        long long start_time;           // steady clock ms
+        int current;
+        uint32_t number;
+        std::shared_ptr<const WORLD_FRAME> frame;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef __ENVIRO_RESPONSE_CACHE__H
+#define __ENVIRO_RESPONSE_CACHE__H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+namespace enviro {
+
+    //! The GET /state responses made from one world's latest frame. Each
+    //! distinct request (format, viewport, and so on, as a key) is
+    //! serialized once per frame, and every other request for it while that
+    //! frame is current is answered with the same buffer. Responses can
+    //! also be kept gzipped, compressed once, for clients that accept it.
+    //! The cache is emptied when the frame changes. Used only from the
+    //! server thread.
+    class ResponseCache {
+
+        public:
+
+        ResponseCache();
+
+        //! The response for key in the given frame, made with serialize if
+        //! it is not cached yet. With gzip, the compressed response.
+        std::shared_ptr<const std::string> get(uint32_t frame, const std::string& key, bool gzip,
+                                               const std::function<std::string()>& serialize);
+
+        //! Prometheus text with the cache's counters.
+        std::string metrics() const;
+
+        private:
+
+        uint32_t _frame;
+        std::map<std::string, std::shared_ptr<const std::string>> _responses, _gzipped;
+        unsigned long long _hits, _misses;
+        long long _serialize_ns, _compress_ns;
+
+    };
+
+    //! Compresses text in the gzip format.
+    std::string gzip(const std::string& text);
+
+}
+
+#endif
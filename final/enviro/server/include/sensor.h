@@ -3,6 +3,8 @@
 
 #include "enviro.h"
 
+#define SENSOR_NOTHING -1 // the type of a reading that hit nothing
+
 namespace enviro {
 
     using namespace elma;
@@ -10,6 +12,13 @@ namespace enviro {
     class Agent;
     class World;
 
+    //! A sensor's reading: the distance to what it sees, and the interned
+    //! type id of that agent (see World::intern_type).
+    typedef struct {
+        double distance;
+        int type;
+    } SENSOR_READING;
+
     class Sensor {
 
         public:
@@ -17,7 +26,11 @@ namespace enviro {
               : _agent_ptr(&agent), _location({x: x, y: y}), _angle(angle) {
         }
 
-        virtual std::pair<double,std::string> value() = 0;
+        virtual ~Sensor() {}
+        virtual SENSOR_READING read() = 0;
+
+        //! The reading with the type id replaced by its name, or "None".
+        std::pair<double,std::string> value();
 
         protected:
         Agent * _agent_ptr; 
@@ -30,7 +43,7 @@ namespace enviro {
 
         public:
         RangeSensor(Agent &agent, double x, double y, double angle) : Sensor(agent,x,y,angle) {}
-        std::pair<double,std::string> value();
+        SENSOR_READING read();
 
     };
 
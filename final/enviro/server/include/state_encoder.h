@@ -0,0 +1,85 @@
+#ifndef __ENVIRO_STATE_ENCODER__H
+#define __ENVIRO_STATE_ENCODER__H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "state_stream.h"
+
+#define STATE_FORMAT_VERSION 1
+
+// Flags
+#define STATE_QUANTIZED 0x01
+
+// The string table starts over, under a new id, when it reaches this size
+#define STATE_TABLE_LIMIT 65536
+
+namespace enviro {
+
+    //! Encodes world frames for GET /state?format=binary, a compact
+    //! alternative to the json document. Agent type definitions and styles
+    //! are interned in a table of json strings that only grows, and each
+    //! response carries just the entries the client does not have yet, so
+    //! a client that keeps the table gets each definition once. Poses are
+    //! 32 bit floats, or, with quantize, 16 bit steps across the range of
+    //! the frame. The layout is decoded by StateDecoder in
+    //! client/src/enviro.js.
+    //!
+    //! Layout (all little-endian, no padding):
+    //!
+    //!   u8 version, u8 flags, u32 table id, u32 frame, u32 timestamp,
+    //!   f32 center x, f32 center y, f32 zoom, f32 interpolation,
+    //!   quantized only: f32 x origin, f32 y origin, f32 position step,
+    //!     f32 velocity step, f32 angular velocity step, f32 sensor step,
+    //!   u32 index of the first new table entry, u32 number of new entries,
+    //!     each a u32 byte count and that many bytes of json,
+    //!   u32 number of agents, then a fixed width record for each:
+    //!     u32 id, u32 definition entry, u32 style entry, and then
+    //!     f32 x, y, theta, vx, vy, omega (36 bytes in all), or when
+    //!     quantized u16 x, y, theta and i16 vx, vy, omega (24 bytes),
+    //!   for each agent, u8 number of sensors and an f32 (quantized: u16)
+    //!     value for each,
+    //!   u32 number of agents with a decoration or label, each a u32 index
+    //!     into the records, f32 label x, f32 label y, then the decoration
+    //!     and label as a u32 byte count and UTF-8 bytes.
+    //!
+    //! A quantized value is its origin plus the step times the integer.
+    //! Theta is in steps of 2 pi / 65536.
+    class StateEncoder {
+
+        public:
+
+        StateEncoder();
+
+        //! Encodes a frame for a client that holds the first known entries
+        //! of the table with the given id. A client with another table, or
+        //! none, is sent the whole table. With a viewport, only agents
+        //! whose bounding boxes overlap it are included. Must not be called
+        //! from more than one thread at a time.
+        std::string encode(const WORLD_FRAME& frame, uint32_t table, uint32_t known, bool quantize,
+                           const BOUNDS * viewport = NULL);
+
+        inline uint32_t table_id() const { return _table_id; }
+        inline uint32_t table_size() const { return _strings.size(); }
+
+        private:
+
+        uint32_t intern(const std::shared_ptr<const std::string>& s);
+
+        uint32_t _table_id;
+        std::vector<std::shared_ptr<const std::string>> _strings;
+
+        // Definitions are shared by type and styles by agent, so most
+        // lookups hit by pointer before falling back to the text. Strings
+        // looked up by pointer are kept alive so that their addresses are
+        // not reused, and the cache is emptied when it gets large.
+        std::unordered_map<const std::string *, std::pair<std::shared_ptr<const std::string>, uint32_t>> _by_pointer;
+        std::unordered_map<std::string, uint32_t> _by_text;
+
+    };
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef __ENVIRO_STATE_STREAM__H
+#define __ENVIRO_STATE_STREAM__H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
+
+#define STREAM_FORMAT_VERSION 2
+
+// Frame flags
+#define STREAM_KEYFRAME 0x01
+
+// Field groups carried by an agent update. A keyframe, or an agent the
+// client has not seen yet, carries all of them.
+#define STREAM_POSE          0x01
+#define STREAM_VELOCITY      0x02
+#define STREAM_SENSORS       0x04
+#define STREAM_SPECIFICATION 0x08
+#define STREAM_DECORATION    0x10
+#define STREAM_LABEL         0x20
+#define STREAM_ALL_FIELDS    0x3f
+
+namespace enviro {
+
+    //! An axis aligned box in world coordinates, laid out like Chipmunk's
+    //! cpBB.
+    typedef struct {
+        double left, bottom, right, top;
+    } BOUNDS;
+
+    //! The part of an agent's state a viewer needs, captured by the world
+    //! thread into an immutable snapshot.
+    typedef struct {
+        int id;
+        double x, y, theta;
+        double vx, vy, omega;
+        std::vector<double> sensors;
+        std::shared_ptr<const std::string> specification;
+        std::shared_ptr<const std::string> definition;  // the type's, shared
+        std::shared_ptr<const std::string> style;       // json text
+        std::string decoration;
+        std::string label;
+        double label_x, label_y;
+        BOUNDS bounds;              // the shape's bounding box
+    } AGENT_RECORD;
+
+    //! Everything in one state frame. Agents are sorted by id and frame
+    //! numbers increase with each published frame, skipping zero.
+    typedef struct {
+        uint32_t number;
+        double center_x, center_y, zoom;
+        double interpolation;       // fraction of a physics step since this state
+        long int timestamp;
+        std::vector<AGENT_RECORD> agents;
+    } WORLD_FRAME;
+
+    inline bool overlaps(const BOUNDS& a, const BOUNDS& b) {
+        return a.left <= b.right && b.left <= a.right && a.bottom <= b.top && b.bottom <= a.top;
+    }
+
+    //! Writes a frame as the json document served by GET /state. With a
+    //! viewport, only agents whose bounding boxes overlap it are included.
+    std::string frame_to_json(const WORLD_FRAME& frame, const BOUNDS * viewport = NULL);
+
+    //! Reads a viewport of the form view=left,bottom,right,top from a
+    //! request's query string, and grows it by margin on every side.
+    //! Returns false if the query has no valid viewport.
+    bool parse_viewport(std::string_view query, double margin, BOUNDS& viewport);
+
+    //! Finds name=value in a request's query string. Returns false if the
+    //! name is not there.
+    bool query_parameter(std::string_view query, std::string_view name, std::string& value);
+
+    //! Keeps a short history of world frames and encodes the newest one as
+    //! a compact little-endian binary message, either as a keyframe or as
+    //! the fields that changed since a frame the client has acknowledged.
+    //! Poses and sensor values are narrowed to 32 bit floats.
+    //! The layout is decoded by StateStream in client/src/enviro.js.
+    class StateStream {
+
+        public:
+
+        StateStream(int history=32) : _history_size(history) {}
+
+        //! Adds a frame to the history. Returns false, and ignores the 
+        //! frame, if it is already the newest one.
+        bool publish(std::shared_ptr<const WORLD_FRAME> frame);
+
+        //! Encodes the newest frame relative to the given baseline frame. A
+        //! baseline of zero, or one that has fallen out of the history,
+        //! produces a keyframe. Encodings are cached per baseline until the
+        //! next publish, so clients that acknowledged the same frame share
+        //! one buffer.
+        const std::string& encode(uint32_t baseline);
+
+        inline bool empty() const { return _history.empty(); }
+        inline uint32_t latest() const { return _history.empty() ? 0 : _history.back()->number; }
+
+        private:
+
+        std::shared_ptr<const WORLD_FRAME> find(uint32_t number) const;
+        std::string encode(const WORLD_FRAME& current, const WORLD_FRAME * baseline) const;
+
+        int _history_size;
+        std::deque<std::shared_ptr<const WORLD_FRAME>> _history;
+        std::map<uint32_t, std::string> _encoded;
+
+    };
+
+}
+
+#endif
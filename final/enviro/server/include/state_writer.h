@@ -0,0 +1,36 @@
+#ifndef __ENVIRO_STATE_WRITER__H
+#define __ENVIRO_STATE_WRITER__H
+
+#include <fstream>
+#include "enviro.h"
+
+namespace enviro {
+
+    //! A process that appends the world's state to a file as json lines,
+    //! one document per update in the same format as GET /state. It is
+    //! used by headless runs, where there is no server to ask for state.
+    class StateWriter : public Process {
+
+        public:
+
+        //! If periodic is false, only the final state is written, when
+        //! the manager stops.
+        StateWriter(World& world, std::string filename, bool periodic);
+
+        void init() {}
+        void start() {}
+        void update();
+        void stop();
+
+        private:
+        void write();
+
+        World& world;
+        std::ofstream out;
+        bool periodic;
+
+    };
+
+}
+
+#endif
@@ -6,6 +6,12 @@
 
 using namespace enviro;
 
+//! A wall or other fixed shape from the "statics" section of the
+//! configuration. The world bakes statics into its space when it starts
+//! and keeps them out of its agent list, so they are never updated or
+//! included in frames. Clients get them once, from /config. A static is
+//! still an Agent so that sensors and collision handlers that meet its
+//! shape see an agent of type "StaticObject".
 class StaticObject : public Agent {
 
     public:
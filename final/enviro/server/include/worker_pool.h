@@ -0,0 +1,48 @@
+#ifndef __ENVIRO_WORKER_POOL__H
+#define __ENVIRO_WORKER_POOL__H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace enviro {
+
+    //! A fixed set of threads that run the iterations of a loop in
+    //! parallel. The calling thread works on the loop too, so a pool of
+    //! size n uses n-1 extra threads.
+    class WorkerPool {
+
+        public:
+
+        WorkerPool(int size);
+        ~WorkerPool();
+
+        //! Calls f(i) for every i in [0, count) and returns when all calls
+        //! have finished. Not reentrant.
+        void parallel_for(int count, std::function<void(int)> f);
+
+        inline int size() const { return _threads.size() + 1; }
+
+        private:
+
+        void work();
+        void run_batch();
+
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _start, _done;
+        std::function<void(int)> _job;
+        std::atomic<int> _next;
+        int _count;
+        int _busy;
+        unsigned long _batch;
+        bool _quit;
+
+    };
+
+}
+
+#endif
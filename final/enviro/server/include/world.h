@@ -4,9 +4,25 @@
 #include <iostream>
 #include <chrono>
 #include <tuple>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
 #include "elma/elma.h"
 #include "chipmunk.h"
 #include "enviro.h"
+#include "worker_pool.h"
+#include "profiler.h"
+#include "frame_source.h"
+#include "raycaster.h"
+
+#define AGENT_SLOT_BITS 20
+#define AGENT_SLOT_MASK ((1 << AGENT_SLOT_BITS) - 1)
+#define AGENT_MAX_GENERATION ((1 << (31 - AGENT_SLOT_BITS)) - 1)
+
+#define AGENT_PERIOD 100_ms
 
 using namespace std::chrono;
 using namespace elma;
@@ -15,31 +31,71 @@ namespace enviro {
 
     class Agent;
 
-    typedef struct {
-        json specification;
+    //! A loaded agent type. Its definition is parsed, checked and baked
+    //! once, and every agent of the type shares it. Agents only carry their
+    //! own position and style, with "definition" set to the type's name.
+    typedef struct AGENT_TYPE {
+        int id;                                         // interned type id
+        std::shared_ptr<const json> definition;
+        std::shared_ptr<const std::string> definition_text;
+        AGENT_PARAMETERS params;
+        std::vector<cpVect> vertices;                   // polygon shapes only
         void * handle;
         Agent* (*create_agent)(json spec, World&);
         void (*destroy_agent)(Agent*);
+
+        // Exported by plugins built with this version of DECLARE_INTERFACE,
+        // and NULL otherwise. They let agents be built in recycled storage.
+        size_t (*agent_size)();
+        Agent* (*construct_agent)(void * memory, json spec, World&);
+        void (*destruct_agent)(Agent*);
+
+        // Storage, bodies and shapes of removed agents, for reuse by the
+        // next agents of this type.
+        std::vector<void *> free_storage;
+        std::vector<std::pair<cpBody *, cpShape *>> free_bodies;
     } AGENT_TYPE;     
 
-    class World : public Process {
+    class World : public Process, public FrameSource {
         public:
 
         World(json config, Manager& m);
         ~World();
 
         void init();
-        void start() {}
+        void start();
         void update();
-        void stop() {}
+        void stop();
 
         inline cpSpace * get_space() { return space; }
+
+        //! The number of physics steps taken so far.
+        inline unsigned long get_step() const { return step_count; }
+
+        //! Wall clock time between physics steps, from steps_per_second.
+        //! Scheduling the world at this period gives one step per update.
+        inline double get_step_period_ms() const { return 1000.0 / steps_per_second; }
+        inline high_resolution_clock::duration get_step_period() const {
+            return duration_cast<high_resolution_clock::duration>(duration<double, std::milli>(get_step_period_ms()));
+        }
+
+        //! Timings of world updates, agent controllers and sensors.
+        inline Profiler& get_profiler() { return profiler; }
+
+        //! How far the clock is into the next physics step, from 0 to 1.
+        //! Exported with each frame so viewers can extrapolate poses.
+        inline double get_interpolation() const { return interpolation; }
         World& add_agent(Agent& agent);
         Agent& add_agent(const std::string name, double x, double y, double theta, const json style);
+        //! Calls f on every agent in the world, except statics, which
+        //! are kept out of the agent list.
         World& all(std::function<void(Agent&)> f);
         inline json get_config() const { return config; }
+        inline void handle_event(const Event& e) { emit(e); }
+        inline std::string metrics() { return profiler.prometheus(); }
         Agent& find_agent(int id);
         void add_constraint(Agent& a, Agent& b);
+        //! True if the two agents are pinned together, in either order.
         bool attached(Agent& a, Agent& b);
         bool exists(int id);
         void remove(int id);
@@ -47,6 +103,68 @@ namespace enviro {
         void process_removals();
         void add_agent_type(std::string name, AGENT_TYPE * at);
         AGENT_TYPE * add_agent_type(json spec);
+        AGENT_TYPE * get_agent_type(const std::string& name);
+
+        //! Returns the agent with the given id, or NULL if the id is stale.
+        //! Agents spawned by parallel controllers register while others
+        //! look ids up, so the table is read under a shared lock then.
+        inline Agent * lookup(int id) const {
+            std::shared_lock<std::shared_mutex> lock(space_mutex, std::defer_lock);
+            if ( parallel_phase ) {
+                lock.lock();
+            }
+            return slot_agent(id);
+        }
+        int register_agent(Agent * agent);
+        void release_agent_id(int id);
+
+        //! Returns the small integer id for an agent type name, adding it if
+        //! it is new. Ids count up from zero and never change, so agents 
+        //! compare and index types by id instead of by name. Must be called
+        //! from the world thread, or with the space locked exclusively.
+        int intern_type(const std::string& name);
+
+        //! Returns the id of an agent type name, or -1 if it is unknown.
+        int type_id(const std::string& name);
+        //! Returns the name of an agent type id. Safe to call while
+        //! controllers run in parallel.
+        inline const std::string& type_name(int id) const {
+            std::shared_lock<std::shared_mutex> lock(space_mutex, std::defer_lock);
+            if ( parallel_phase ) {
+                lock.lock();
+            }
+            return type_names[id];
+        }
+
+        //! Each agent type gets its own Chipmunk collision type, so that the
+        //! space only calls back for pairs of types someone is watching.
+        static cpCollisionType collision_type(int type_id);
+
+        //! Makes collisions between the two types reach their agents'
+        //! handle_collision methods, from the next step on. Returns the id
+        //! of other_type.
+        int watch_collisions(int type, const std::string& other_type);
+
+        //! Returns the most recently published snapshot of the world. Safe to
+        //! call from any thread without holding the manager mutex. The world
+        //! thread publishes snapshots at the end of its updates, every
+        //! snapshot_period ms while they are being read and every quarter
+        //! second otherwise, so a snapshot is never much older than that.
+        std::shared_ptr<const WORLD_FRAME> snapshot();
+        void publish_snapshot();
+
+        //! Builds a new frame from the current state. Must be called from
+        //! the world thread.
+        std::shared_ptr<const WORLD_FRAME> capture();
+
+        //! True while controllers are being updated in parallel. Code that
+        //! reads the space during that phase must hold a shared lock on
+        //! get_space_mutex(), and code that changes it an exclusive one.
+        inline bool in_parallel_phase() const { return parallel_phase; }
+        inline std::shared_mutex& get_space_mutex() { return space_mutex; }
+
+        //! Answers range sensor queries from a copy of the space's shapes.
+        inline Raycaster& get_raycaster() { return raycaster; }
 
         inline void set_center(double x, double y) { center_x = x; center_y = y; }
         inline void set_zoom(double z) { zoom = z; }
@@ -57,16 +175,82 @@ namespace enviro {
         private:
         map<std::string, AGENT_TYPE *> agent_types;
         vector<Agent *> agents, new_agents, garbage;
+        vector<Agent *> statics;                // in the space, but never updated
         cpSpace * space;
-        cpFloat timeStep;
+        unsigned long step_count;
+        int shape_count;
+        Profiler profiler;
+
+        // Fixed timestep physics. Each step advances the simulation by
+        // time_step seconds, in substeps equal parts, and steps are taken
+        // steps_per_second times per second of manager time.
+        void step();
+        cpFloat time_step;
+        double steps_per_second;
+        int substeps;
+        int max_catch_up_steps;
+        double accumulator;                     // ms owed to the simulation
+        double last_step_time;                  // ms
+        double interpolation;
         json config;
-        cpCollisionHandler * collsion_handler;
+        void install_collision_handlers();
+        Agent * create_agent(AGENT_TYPE * at, const json& spec);
+        void destroy_agent(Agent * agent, bool recycle);
         Manager * manager_ptr;
         double center_x, center_y, zoom;
 
-        // A pin joint connecting agents with the given ids.
-        typedef std::tuple<int, int, cpConstraint*> Constraint;
-        vector<Constraint> new_constraints, constraints;       
+        void update_controllers();
+        std::unique_ptr<WorkerPool> workers;
+        mutable std::shared_mutex space_mutex;
+        bool parallel_phase;
+        vector<Agent *> spawned;                // by controllers in the parallel phase
+        Raycaster raycaster;
+        double next_controller_time;            // ms
+
+        // Only touched through std::atomic_load and std::atomic_store
+        std::shared_ptr<const WORLD_FRAME> latest_snapshot;
+        std::atomic<long long> snapshot_demand; // steady clock ms of the last read
+        long long last_snapshot_time;
+        uint32_t snapshot_number;
+        int snapshot_period;                    // minimum ms between snapshots
+
+        // Agent ids are generational handles into this table. The low 
+        // AGENT_SLOT_BITS of an id select a slot and the remaining bits
+        // must match the slot's generation, which is bumped every time the
+        // slot is released, so stale ids never alias a newer agent. Freed
+        // slots are reused in FIFO order to spread generations out, and a
+        // slot is retired once its generation reaches AGENT_MAX_GENERATION,
+        // which takes about two billion removals in a full table.
+        typedef struct {
+            Agent * agent;
+            int generation;
+        } AGENT_SLOT;
+        vector<AGENT_SLOT> slots;
+        std::deque<int> free_slots;
+        inline Agent * slot_agent(int id) const {
+            unsigned int slot = id & AGENT_SLOT_MASK;
+            if ( id < 0 || slot >= slots.size() || slots[slot].generation != ( id >> AGENT_SLOT_BITS ) ) {
+                return NULL;
+            }
+            return slots[slot].agent;
+        }
+
+        // Interned agent types. Collision handlers are only installed for
+        // type pairs that are being watched, and pairs watched during a step
+        // or while controllers run are installed before the next step.
+        map<std::string, int> type_ids;
+        std::deque<std::string> type_names;     // names stay put as more are added
+        std::set<std::pair<int, int>> collision_pairs;
+        vector<std::pair<int, int>> new_collision_pairs;
+
+        // Pin joints, indexed both ways by the ids of the agents they
+        // connect, so attachment checks are order independent and removing
+        // an agent only visits its own joints. Joints made since the last
+        // update are also in new_constraints until they are added to the
+        // space.
+        bool is_attached(int a, int b) const;
+        std::unordered_map<int, std::unordered_map<int, cpConstraint *>> adjacency;
+        vector<cpConstraint *> new_constraints;
 
     };
 
@@ -6,8 +6,14 @@
 #include <map>
 #include <string>
 #include <mutex>
+#include <set>
+#include <vector>
 
 #include "enviro.h"
+#include "state_stream.h"
+#include "state_encoder.h"
+#include "response_cache.h"
+#include "frame_source.h"
 #include "uWebSockets/App.h"
 
 using nlohmann::json; 
@@ -17,25 +23,74 @@ namespace enviro {
     long int unix_timestamp();
     class World;
 
+    //! Per connection data for clients of the /stream WebSocket.
+    typedef struct {
+        uint32_t acked;          // last frame the client acknowledged
+        int since_keyframe;      // frames sent since the last keyframe
+    } STREAM_CLIENT;
+
+    typedef uWS::WebSocket<true, true, STREAM_CLIENT> StreamSocket;
+
+    //! A world served by a WorldServer, with the mutex that must be held
+    //! to send it events, the cache of its /state responses, the string
+    //! table its binary /state clients share, and its /stream history and
+    //! clients. Nothing is shared between worlds, so one world's viewers
+    //! never reset another's tables.
+    typedef struct {
+        FrameSource * source;
+        std::mutex * mutex;
+        std::shared_ptr<ResponseCache> cache;
+        std::shared_ptr<StateEncoder> encoder;
+        std::shared_ptr<StateStream> stream;
+        std::set<StreamSocket *> stream_clients;
+    } SERVED_WORLD;
+
     class WorldServer {
 
         public:
 
-        WorldServer(World& world, std::mutex& mutex, json config);
+        WorldServer(FrameSource& world, std::mutex& mutex, json config);
+
+        //! Serves another world at /w/<n>/config, /w/<n>/state,
+        //! /w/<n>/stream, /w/<n>/event and /w/<n>/metrics, where n counts
+        //! up from 1. The first world is world 0, and is also served at the
+        //! top level routes. Worlds must all be added before run.
+        void add_world(FrameSource& world, std::mutex& mutex);
+
         void run();
 
         private:
 
         void get_config(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
         void get_state(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
+        void get_metrics(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
         void process_client_event(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
+        void get_world_config(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
+        void get_world_state(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
+        void get_world_metrics(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
+        void process_world_event(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
+        void send_config(uWS::HttpResponse<true> *res, std::string_view client_id, SERVED_WORLD& w);
+        void send_state(uWS::HttpResponse<true> *res, uWS::HttpRequest *req, SERVED_WORLD& w);
+        SERVED_WORLD * find_world(uWS::HttpResponse<true> *res, uWS::HttpRequest *req);
+        void receive_event(uWS::HttpResponse<true> *res, SERVED_WORLD * w);
         void listen(us_listen_socket_t * token);
+        void open_stream(StreamSocket * ws, SERVED_WORLD * w);
+        void receive_ack(StreamSocket * ws, std::string_view message);
+        void close_stream(StreamSocket * ws, SERVED_WORLD * w);
+        void push_state();
+        void push_state(SERVED_WORLD& w);
 
-        World& world;
+        FrameSource& world;
         std::mutex& manager_mutex;
+        std::vector<SERVED_WORLD> worlds;
         const char* ip;
         int port;
 
+        int stream_period;       // ms between pushed frames
+        int keyframe_interval;   // frames between forced keyframes
+        double viewport_margin;  // added around a client's viewport
+        bool state_gzip;         // compress /state for clients that accept it
+
     };
 
 }
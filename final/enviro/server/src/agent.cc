@@ -1,19 +1,28 @@
 #include <dlfcn.h>
 #include <math.h>
+#include <sys/stat.h>
 #include "enviro.h"
 
 #define IDENTITY { a: 1, b: 0, c: 0, d: 1, tx: 0, ty: 0 }
 
 namespace enviro {
 
-    static int _next_id = 0;
+    static std::string definition_name(const json& specification) {
+        const json& definition = specification["definition"];
+        return definition.is_string() ? definition.get<string>() : definition["name"].get<string>();
+    }
 
     Agent::Agent(json specification, World& world) : 
+        Process(definition_name(specification)),
+        _destroyer(NULL),
         _specification(specification),
+        _pooled(false),
+        _readings_step(-1),
         _world_ptr(&world), 
         _alive(true),
-        _invisible(specification["definition"]["type"] == "invisible"),
-        Process(specification["definition"]["name"].get<string>()) {
+        _deferred(false),
+        _label_x(0),
+        _label_y(0) {
 
         cpSpace * space = world.get_space();
 
@@ -25,98 +34,196 @@ namespace enviro {
             throw std::runtime_error("Cannot add shapes and bodies to space when it is updating. Did you try to add an agent inside a collision callback.");
         }
 
-        _id = _next_id++;
+        // Agents of a loaded type name it in their specification and share
+        // its baked definition. Static objects each carry their own.
+        std::vector<cpVect> own_vertices;
+        if ( specification["definition"].is_string() ) {
+            _type = world.get_agent_type(name());
+            _definition = _type->definition;
+            _definition_text = _type->definition_text;
+            _params = _type->params;
+        } else {
+            _type = NULL;
+            _definition = std::make_shared<const json>(specification["definition"]);
+            _params = decode_parameters(*_definition);
+            own_vertices = bake_vertices(*_definition);
+        }
+        const std::vector<cpVect>& vertices = _type ? _type->vertices : own_vertices;
+        _specification.erase("definition");
 
-        if ( specification["definition"]["type"] == "invisible" || specification["definition"]["shape"].is_array() ) {
+        _id = world.register_agent(this);
+        _body = NULL;
+        _shape = NULL;
 
-            int num_vertices = specification["definition"]["shape"].size();
-            cpVect *vertices = (cpVect *) calloc(num_vertices, sizeof(cpVect));
-            int i = 0;
+        // Nothing refers to the agent until its constructor returns, so if
+        // any of the rest fails, its body, shape and slot are given back
+        // before the exception is passed on
+        try {
 
-            for (auto v : specification["definition"]["shape"]) {
-                vertices[i++] = cpv(v["x"], v["y"]);
-            }
+            _type_id = world.intern_type(name());
+
+            bool physical = _params.kind == AGENT_DYNAMIC || _params.kind == AGENT_STATIC;
+            bool polygon = _params.kind == AGENT_INVISIBLE || _params.shape == AGENT_SHAPE_POLYGON;
 
-            if ( specification["definition"]["type"] == "dynamic" || specification["definition"]["type"] == "static" ) {
+            if ( !polygon ) {
+                _moment_of_inertia = cpMomentForCircle(
+                    _params.mass, 
+                    _params.radius,
+                    _params.radius,
+                    cpv(0,0));
+            } else if ( physical ) {
                 _moment_of_inertia = cpMomentForPoly(
-                    specification["definition"]["mass"], 
-                    num_vertices, 
-                    vertices, 
+                    _params.mass, 
+                    vertices.size(), 
+                    vertices.data(), 
                     cpvzero, 1);
             } else {
                 _moment_of_inertia = 1;
             }
 
-            _body = cpSpaceAddBody(
-                space, 
-                cpBodyNew(
-                    !specification["definition"]["mass"].is_null() ? specification["definition"]["mass"].get<double>() : 1, 
-                    _moment_of_inertia));
+            if ( _type && !_type->free_bodies.empty() ) {
+
+                // Reuse the body and shape of a removed agent of the same type,
+                // which already have this type's mass, shape and collision type
+                std::tie(_body, _shape) = _type->free_bodies.back();
+                _type->free_bodies.pop_back();
+                cpBodySetVelocity(_body, cpvzero);
+                cpBodySetAngularVelocity(_body, 0);
+                cpBodySetForce(_body, cpvzero);
+                cpBodySetTorque(_body, 0);
+                if ( _params.kind != AGENT_STATIC ) {
+                    cpBodySetMoment(_body, _moment_of_inertia);
+                }
+
+            } else {
+
+                _body = cpBodyNew(_params.mass, _moment_of_inertia);
+
+                if ( !polygon ) {
+                    _shape = cpCircleShapeNew(_body, _params.radius, cpv(0,0));
+                } else if ( physical ) {
+                    _shape = cpPolyShapeNew(
+                        _body, 
+                        vertices.size(), 
+                        vertices.data(), 
+                        IDENTITY, 1);
+                }
+
+                if ( physical ) {
+                    cpShapeSetFriction(_shape, _params.collision_friction); 
+                    cpShapeSetElasticity(_shape, 0.0);       
+                    cpShapeSetCollisionType(_shape, World::collision_type(_type_id)); 
+                }
+
+                if ( _params.kind == AGENT_STATIC ) {
+                    cpBodySetType(_body, CP_BODY_TYPE_STATIC);
+                }
 
-            if ( specification["definition"]["type"] != "invisible" ) {
+            }
+
+            if ( _params.kind != AGENT_INVISIBLE ) {
                 cpBodySetPosition(_body, cpv(
                     specification["position"]["x"], 
                     specification["position"]["y"]
                 ));
-                cpBodySetAngle(_body, specification["position"]["theta"]);
+                cpBodySetAngle(_body, polygon ? specification["position"]["theta"].get<cpFloat>() : 0);
             } else {
                 cpBodySetPosition(_body, cpv(0,0));
                 cpBodySetAngle(_body, 0);                
             }
 
-            if ( specification["definition"]["type"] == "dynamic" || specification["definition"]["type"] == "static" ) {
-                _shape = cpSpaceAddShape(
-                    space, 
-                    cpPolyShapeNew(
-                        _body, 
-                        num_vertices, 
-                        vertices, 
-                        IDENTITY, 1));
+            if ( physical ) {
+                cpShapeSetFilter(_shape, cpShapeFilterNew(get_shape_group(), AGENT_SENSOR_CATEGORY, CP_ALL_CATEGORIES));
             }
-            
-        } else {
 
-            _moment_of_inertia = cpMomentForCircle(
-                specification["definition"]["mass"], 
-                specification["definition"]["radius"],
-                specification["definition"]["radius"],
-                cpv(0,0));     
+            cpBodySetUserData(_body, this);
 
-            _body = cpSpaceAddBody(
-                space, 
-                cpBodyNew(
-                    specification["definition"]["mass"], 
-                    _moment_of_inertia));    
+            // An agent spawned while controllers run in parallel joins the
+            // space when they have all finished
+            if ( !world.in_parallel_phase() ) {
+                enter_space();
+            }
+
+            setup_sensors();
 
-            cpBodySetPosition(_body, cpv(
-                specification["position"]["x"], 
-                specification["position"]["y"]
-            ));     
+        } catch ( ... ) {
+            for ( auto sensor : _sensors ) {
+                delete sensor;
+            }
+            _sensors.clear();
+            if ( _shape && cpSpaceContainsShape(space, _shape) ) {
+                cpSpaceRemoveShape(space, _shape);
+                world.get_raycaster().shapes_changed();
+            }
+            if ( _body && cpSpaceContainsBody(space, _body) ) {
+                cpSpaceRemoveBody(space, _body);
+            }
+            cpShapeFree(_shape);
+            cpBodyFree(_body);
+            world.release_agent_id(_id);
+            throw;
+        }
 
-            _shape = cpSpaceAddShape(
-                space, 
-                cpCircleShapeNew(_body, specification["definition"]["radius"], cpv(0,0)));  
+    }
 
+    std::vector<cpVect> Agent::bake_vertices(const json& definition) {
+        std::vector<cpVect> vertices;
+        auto shape = definition.find("shape");
+        if ( shape != definition.end() && shape->is_array() ) {
+            for ( auto& v : *shape ) {
+                vertices.push_back(cpv(v["x"], v["y"]));
+            }
         }
+        return vertices;
+    }
+
+    AGENT_PARAMETERS Agent::decode_parameters(const json& definition) {
 
-        if ( specification["definition"]["type"] == "dynamic" || specification["definition"]["type"] == "static" ) {
-          cpShapeSetFriction(_shape, specification["definition"]["friction"]["collision"].get<cpFloat>()); 
-          cpShapeSetElasticity(_shape, 0.0);       
-          cpShapeSetCollisionType(_shape, AGENT_COLLISION_TYPE); 
+        AGENT_PARAMETERS params = { AGENT_DYNAMIC, AGENT_SHAPE_NONE, 1, 0, 0, 0, 0 };
+
+        std::string type = definition["type"].get<std::string>();
+        if ( type == "static" ) {
+            params.kind = AGENT_STATIC;
+        } else if ( type == "noninteractive" ) {
+            params.kind = AGENT_NONINTERACTIVE;
+        } else if ( type == "invisible" ) {
+            params.kind = AGENT_INVISIBLE;
         }
 
-        if ( specification["definition"]["type"] == "static" ) {
-            cpBodySetType(_body, CP_BODY_TYPE_STATIC);
+        auto shape = definition.find("shape");
+        if ( shape != definition.end() && shape->is_array() ) {
+            params.shape = AGENT_SHAPE_POLYGON;
+        } else if ( shape != definition.end() && shape->is_string() ) {
+            params.shape = AGENT_SHAPE_OMNI;
         }
 
-        cpBodySetUserData(_body, this);
+        auto mass = definition.find("mass");
+        if ( mass != definition.end() && mass->is_number() ) {
+            params.mass = mass->get<cpFloat>();
+        }
 
-        setup_sensors();
+        auto radius = definition.find("radius");
+        if ( radius != definition.end() && radius->is_number() ) {
+            params.radius = radius->get<cpFloat>();
+        }
+
+        auto friction = definition.find("friction");
+        if ( friction != definition.end() && friction->is_object() ) {
+            params.collision_friction = friction->value("collision", 0.0);
+            params.linear_friction = friction->value("linear", 0.0);
+            params.rotational_friction = friction->value("rotational", 0.0);
+        }
+
+        return params;
 
     }
 
     void Agent::setup_sensors() {
-        for ( auto spec : _specification["definition"]["sensors"] ) {
+        auto sensors = definition().find("sensors");
+        if ( sensors == definition().end() ) {
+            return;
+        }
+        for ( auto& spec : *sensors ) {
             if ( spec["type"] == "range" ) {
                 _sensors.push_back(new RangeSensor(
                     *this,
@@ -130,26 +237,46 @@ namespace enviro {
         }
     }
 
+    const std::vector<SENSOR_READING>& Agent::sensor_readings() {
+        unsigned long step = _world_ptr->get_step();
+        if ( _readings_step != step ) {
+            auto start = steady_clock::now();
+            _readings.resize(_sensors.size());
+            for ( int i=0; i<_sensors.size(); i++ ) {
+                _readings[i] = _sensors[i]->read();
+            }
+            _readings_step = step;
+            _world_ptr->get_profiler().add_work(WORK_SENSOR, 
+                duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        }
+        return _readings;
+    }
+
     double Agent::sensor_value(int index) {
         if ( index < _sensors.size() ) {
-            return _sensors[index]->value().first;
+            return sensor_readings()[index].distance;
         } else {
             throw Exception("Sensor index out of range");
         }
     }    
 
-    std::string Agent::sensor_reflection_type(int index) {
+    int Agent::sensor_reflection_type_id(int index) {
         if ( index < _sensors.size() ) {
-            return _sensors[index]->value().second;
+            return sensor_readings()[index].type;
         } else {
             throw Exception("Sensor index out of range");
         }
+    }
+
+    std::string Agent::sensor_reflection_type(int index) {
+        int type = sensor_reflection_type_id(index);
+        return type == SENSOR_NOTHING ? "None" : _world_ptr->type_name(type);
     }       
 
     std::vector<double> Agent::sensor_values() {
         std::vector<double> values;
-        for ( int i=0; i<_sensors.size(); i++ ) {
-            values.push_back(sensor_value(i));
+        for ( auto& r : sensor_readings() ) {
+            values.push_back(r.distance);
         }
         return values;
     }
@@ -176,9 +303,12 @@ namespace enviro {
     }
 
     void Agent::update() {
+        auto start = steady_clock::now();
         for ( Process * p : _processes ) {
             p->update();
         }
+        _world_ptr->get_profiler().add_work(WORK_CONTROLLER, 
+            duration_cast<nanoseconds>(steady_clock::now() - start).count());
     }
 
     void Agent::stop() {
@@ -203,8 +333,7 @@ namespace enviro {
 
         cpVect F = cpvadd(cpvmult(velocity(), -kL), f);
 
-        cpBodySetForce(_body, F );
-        cpBodySetTorque(_body, - kR * angular_velocity() );
+        actuate({ COMMAND_FORCE, F, - kR * angular_velocity() });
 
         return *this;
 
@@ -226,8 +355,7 @@ namespace enviro {
 
         cpVect F = cpvadd(cpvmult(velocity(), -kL), f);
 
-        cpBodySetForce(_body, F );
-        cpBodySetTorque(_body, torque - kR * angular_velocity() );
+        actuate({ COMMAND_FORCE, F, torque - kR * angular_velocity() });
 
         return *this;
 
@@ -305,13 +433,54 @@ namespace enviro {
     }    
 
     Agent& Agent::teleport(cpFloat x, cpFloat y, cpFloat theta) {
-        cpBodySetPosition(_body, {x: x, y: y});
-        cpBodySetAngle(_body, theta);
-        cpBodySetVelocity(_body, {x:0, y:0});
-        cpBodySetAngularVelocity(_body,0);
+        actuate({ COMMAND_TELEPORT, {x: x, y: y}, theta });
         return *this;
     }
 
+    void Agent::actuate(const ACTUATOR_COMMAND& command) {
+        if ( _deferred ) {
+            _commands.push_back(command);
+        } else {
+            execute(command);
+        }
+    }
+
+    void Agent::execute(const ACTUATOR_COMMAND& command) {
+        switch ( command.type ) {
+            case COMMAND_FORCE:
+                cpBodySetForce(_body, command.v);
+                cpBodySetTorque(_body, command.a);
+                break;
+            case COMMAND_TELEPORT:
+                cpBodySetPosition(_body, command.v);
+                cpBodySetAngle(_body, command.a);
+                cpBodySetVelocity(_body, {x:0, y:0});
+                cpBodySetAngularVelocity(_body,0);
+                _world_ptr->get_raycaster().moved();
+                break;
+            case COMMAND_MOMENT:
+                cpBodySetMoment(_body, command.a);
+                break;
+        }
+    }
+
+    void Agent::enter_space() {
+        cpSpace * space = _world_ptr->get_space();
+        cpSpaceAddBody(space, _body);
+        if ( _shape ) {
+            cpSpaceAddShape(space, _shape);
+            _world_ptr->get_raycaster().shapes_changed();
+        }
+    }
+
+    void Agent::apply_commands() {
+        _deferred = false;
+        for ( auto& c : _commands ) {
+            execute(c);
+        }
+        _commands.clear();
+    }
+
     Agent& Agent::add_process(Process &p) {
         _processes.push_back(&p);
         AgentInterface * ai = dynamic_cast<AgentInterface *>(&p);
@@ -334,6 +503,9 @@ namespace enviro {
     }    
 
     Agent::~Agent() {
+        for ( auto sensor : _sensors ) {
+            delete sensor;
+        }
         cpShapeFree(_shape);
         cpBodyFree(_body);
     }
@@ -355,7 +527,7 @@ namespace enviro {
                     { "theta", cpBodyGetAngularVelocity(_body)}
                 },
             },
-            {"specification", _specification},
+            {"specification", full_specification()},
             {"sensors", sensor_values() },
             {"decoration", _decoration },
             {"label", {
@@ -367,29 +539,105 @@ namespace enviro {
         };            
     }
 
+    AGENT_RECORD Agent::record() {
+        cpVect pos = cpBodyGetPosition(_body);
+        cpVect vel = cpBodyGetVelocity(_body);
+        AGENT_RECORD r;
+        r.id = get_id();
+        r.x = pos.x;
+        r.y = pos.y;
+        r.theta = cpBodyGetAngle(_body);
+        r.vx = vel.x;
+        r.vy = vel.y;
+        r.omega = cpBodyGetAngularVelocity(_body);
+        for ( auto& reading : sensor_readings() ) {
+            r.sensors.push_back(reading.distance);
+        }
+        r.specification = specification_text();
+        r.definition = _definition_text;
+        if ( !_style_text ) {
+            auto style = _specification.find("style");
+            _style_text = std::make_shared<const std::string>(style == _specification.end() ? "{}" : style->dump());
+        }
+        r.style = _style_text;
+        r.decoration = _decoration;
+        r.label = _label;
+        r.label_x = _label_x;
+        r.label_y = _label_y;
+        if ( _shape ) {
+            cpBB bb = cpShapeGetBB(_shape);
+            r.bounds = { bb.l, bb.b, bb.r, bb.t };
+        } else {
+            r.bounds = { r.x, r.y, r.x, r.y }; // noninteractive polygons have no shape
+        }
+        return r;
+    }
+
+    json Agent::full_specification() const {
+        json spec = _specification;
+        spec["definition"] = definition();
+        return spec;
+    }
+
+    std::shared_ptr<const std::string> Agent::specification_text() {
+        if ( !_specification_text ) {
+            // Splice the definition, which is shared by every agent of the
+            // type and dumped once, in front of this agent's own fields
+            if ( !_definition_text ) {
+                _definition_text = std::make_shared<const std::string>(_definition->dump());
+            }
+            std::string text = "{\"definition\":" + *_definition_text;
+            for ( auto& item : _specification.items() ) {
+                if ( item.key() != "definition" ) {
+                    text += "," + json(item.key()).dump() + ":" + item.value().dump();
+                }
+            }
+            text += "}";
+            _specification_text = std::make_shared<const std::string>(text);
+        }
+        return _specification_text;
+    }
+
     // Collisions
     Agent& Agent::notice_collisions_with(const std::string agent_type, std::function<void(Event&)> handler) {
-        collision_handlers[agent_type] = handler;
+        watch_collisions(agent_type, { handler, nullptr });
+        return *this;
+    }
+
+    Agent& Agent::notice_collisions_with(const std::string agent_type, std::function<void(const COLLISION&)> handler) {
+        watch_collisions(agent_type, { nullptr, handler });
         return *this;
     }
 
+    void Agent::watch_collisions(const std::string& agent_type, COLLISION_HANDLER handler) {
+        int other = _world_ptr->watch_collisions(_type_id, agent_type);
+        collision_handlers[other] = handler;
+    }
+
     Agent& Agent::ignore_collisions_with(const std::string agent_type) {
-        collision_handlers.erase(agent_type);
+        int other = _world_ptr->type_id(agent_type);
+        if ( other >= 0 ) {
+            collision_handlers.erase(other);
+        }
         return *this;
     }  
 
     Agent& Agent::handle_collision(const Agent &other) {
-        std::string other_type = other.definition()["name"];
-        auto i = collision_handlers.find(other_type);
-        if ( i != collision_handlers.end() ) {
-            auto handler = collision_handlers[other_type];
+        auto i = collision_handlers.find(other._type_id);
+        if ( i == collision_handlers.end() ) {
+            return *this;
+        }
+        if ( i->second.record ) {
+            COLLISION c = { other.get_id(), other._type_id, other.x(), other.y() };
+            i->second.record(c);
+        } else {
             Event e("collision", {
-                { "type", other_type },
+                { "type", _world_ptr->type_name(other._type_id) },
                 { "x", other.x() },
                 { "y", other.y() },
                 {"id", other.get_id() }
             });
-            handler(e);
+            i->second.event(e);
         }
         return *this;
     }
@@ -405,18 +653,20 @@ namespace enviro {
     } 
 
     Agent& Agent::prevent_rotation() {
-        cpBodySetMoment(_body, INFINITY);
+        actuate({ COMMAND_MOMENT, cpvzero, INFINITY });
         return *this;
     }
 
     Agent& Agent::allow_rotation() {
-        cpBodySetMoment(_body, _moment_of_inertia);
+        actuate({ COMMAND_MOMENT, cpvzero, _moment_of_inertia });
         return *this;
     }     
 
     // Styles
     Agent& Agent::set_style(json style) {
         _specification["style"] = style;
+        _specification_text.reset();
+        _style_text.reset();
         return *this;
     }
 
@@ -425,6 +675,8 @@ namespace enviro {
 
     bool Agent::agent_exists(int id) { return _world_ptr->exists(id); }
 
+    Agent * Agent::lookup_agent(int id) { return _world_ptr->lookup(id); }
+
     Agent& Agent::add_agent(const std::string name, double x, double y, double theta, const json style) { 
         return _world_ptr->add_agent(name,x,y,theta,style); 
     }
@@ -439,16 +691,16 @@ namespace enviro {
 
     // Class wide methods /////////////////////////////////////////
 
-    json Agent::build_specification(json agent_entry) {
+    // Parses a definition file and checks it against the schema for its type
+    static std::shared_ptr<const json> read_definition(const std::string& path) {
 
-        json result = agent_entry, 
-             definition;
+        json definition;
 
         try {
-            definition = json_helper::read(result["definition"]);
+            definition = json_helper::read(path);
         } catch ( const nlohmann::detail::parse_error &e ) {
             std::string msg = "Could not parse ";
-            msg += result["definition"];
+            msg += path;
             msg += ": ";
             msg += e.what();
             throw std::runtime_error(msg);
@@ -456,7 +708,7 @@ namespace enviro {
 
         if ( definition["type"].is_null() ) {
             std::string msg = "The definiton in ";
-            msg += result["definition"];
+            msg += path;
             msg += " has no type specified";
             throw std::runtime_error(msg);
         }
@@ -468,7 +720,7 @@ namespace enviro {
                 json_helper::check(definition, ENVIRO_OMNI_AGENT_SCHEMA);
             } else { 
                 std::string msg = "Could not find a valid shape definition in agent definition in ";
-                msg += result["definition"];
+                msg += path;
                 throw std::runtime_error(msg);
             }
         } else if ( definition["type"] == "noninteractive" ) {
@@ -477,13 +729,73 @@ namespace enviro {
             json_helper::check(definition, ENVIRO_INVISIBLE_SCHEMA);
         } else {
             std::string msg = "The definiton in ";
-            msg += result["definition"];
+            msg += path;
             msg += " has and unknown type";
             msg += definition["type"];
             throw std::runtime_error(msg);
         }
 
-        result["definition"] = definition;
+        return std::make_shared<const json>(std::move(definition));
+
+    }
+
+    typedef struct {
+        long long modified;    // ns since the epoch
+        std::shared_future<std::shared_ptr<const json>> definition;
+    } DEFINITION_CACHE_ENTRY;
+
+    static std::mutex definition_cache_mutex;
+    static std::map<std::string, DEFINITION_CACHE_ENTRY> definition_cache;
+
+    // Finds or starts the load of a definition file. Loads started with
+    // std::launch::deferred run in the first thread that waits for them.
+    static std::shared_future<std::shared_ptr<const json>> definition_future(const std::string& path, std::launch policy) {
+
+        struct stat info;
+        long long modified = -1;
+        if ( stat(path.c_str(), &info) == 0 ) {
+            modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+        }
+
+        std::lock_guard<std::mutex> lock(definition_cache_mutex);
+        auto i = definition_cache.find(path);
+        if ( i != definition_cache.end() && i->second.modified == modified && modified >= 0 ) {
+            return i->second.definition;
+        }
+        auto f = std::async(policy, read_definition, path).share();
+        definition_cache[path] = { modified, f };
+        return f;
+
+    }
+
+    std::shared_ptr<const json> Agent::load_definition(const std::string& path) {
+        return definition_future(path, std::launch::deferred).get();
+    }
+
+    void Agent::preload_definitions(const std::vector<json>& entries) {
+
+        std::set<std::string> paths;
+        for ( auto& entry : entries ) {
+            if ( entry["definition"].is_string() ) {
+                paths.insert(entry["definition"].get<std::string>());
+            }
+        }
+
+        // Errors are rethrown when build_specification asks for the file
+        std::vector<std::shared_future<std::shared_ptr<const json>>> loads;
+        for ( auto& path : paths ) {
+            loads.push_back(definition_future(path, std::launch::async));
+        }
+        for ( auto& f : loads ) {
+            f.wait();
+        }
+
+    }
+
+    json Agent::build_specification(json agent_entry) {
+
+        json result = agent_entry;
+        result["definition"] = *load_definition(result["definition"].get<std::string>());
         return result;
 
     }
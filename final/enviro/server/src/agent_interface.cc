@@ -132,6 +132,11 @@ std::string AgentInterface::sensor_reflection_type(int index) {
 std::vector<std::string> AgentInterface::sensor_reflection_types() {
     ASSERT_AGENT_EXISTS("sensor_reflection_types");
     return agent->sensor_reflection_types();
+}
+
+int AgentInterface::sensor_reflection_type_id(int index) {
+    ASSERT_AGENT_EXISTS("sensor_reflection_type_id");
+    return agent->sensor_reflection_type_id(index);
 }     
 
 // Collisions
@@ -140,6 +145,11 @@ void AgentInterface::notice_collisions_with(const std::string agent_type, std::f
     agent->notice_collisions_with(agent_type, handler);  
 }
 
+void AgentInterface::notice_collisions_with(const std::string agent_type, std::function<void(const COLLISION&)> handler) {
+    ASSERT_AGENT_EXISTS("notice_collisions_with");
+    agent->notice_collisions_with(agent_type, handler);  
+}
+
 void AgentInterface::ignore_collisions_with(const std::string agent_type) {
     ASSERT_AGENT_EXISTS("ignore_collisions_with");
     agent->ignore_collisions_with(agent_type);  
@@ -167,6 +177,11 @@ void AgentInterface::allow_rotation() {
 }
 
 // Agent Management
+Agent * AgentInterface::lookup_agent(int id) {
+    ASSERT_AGENT_EXISTS("lookup_agent");
+    return agent->lookup_agent(id);
+}
+
 void AgentInterface::remove_agent(int id) {
     ASSERT_AGENT_EXISTS("remove_agent");
     agent->remove_agent(id);    
@@ -0,0 +1,23 @@
+#include <stdexcept>
+#include "agent_registry.h"
+
+namespace enviro {
+
+    std::map<std::string, AGENT_FACTORY>& AgentRegistry::types() {
+        static std::map<std::string, AGENT_FACTORY> registered;
+        return registered;
+    }
+
+    bool AgentRegistry::add(const std::string& controller, AGENT_FACTORY factory) {
+        if ( !types().emplace(controller, factory).second ) {
+            throw std::runtime_error("Two agent types were compiled in for " + controller);
+        }
+        return true;
+    }
+
+    const AGENT_FACTORY * AgentRegistry::find(const std::string& controller) {
+        auto i = types().find(controller);
+        return i == types().end() ? NULL : &i->second;
+    }
+
+}
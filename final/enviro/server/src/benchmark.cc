@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <mutex>
+#include "benchmark.h"
+
+namespace enviro {
+
+    static long long steady_ns() {
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Percentiles of a list of samples, in seconds
+    static json summary(std::vector<long long> samples) {
+        int n = samples.size();
+        std::sort(samples.begin(), samples.end());
+        auto q = [&](double f) { 
+            return n == 0 ? 0.0 : samples[std::min(n - 1, (int) ( f * n ))] / 1e9; 
+        };
+        long long total = 0;
+        for ( auto s : samples ) {
+            total += s;
+        }
+        return {
+            { "p50", q(0.5) },
+            { "p90", q(0.9) },
+            { "p99", q(0.99) },
+            { "max", q(1.0) },
+            { "mean", n == 0 ? 0.0 : total / 1e9 / n }
+        };
+    }
+
+    Benchmark::Benchmark(World& world, std::string filename, json label, int readers, double startup)
+        : Process("Benchmark"),
+          world(world),
+          out(filename, std::ios::app),
+          label(label),
+          startup(startup),
+          json_bytes(0),
+          binary_bytes(0),
+          compact_bytes(0),
+          quantized_bytes(0),
+          agents(0),
+          readers(readers),
+          reading(false),
+          reads(0),
+          reading_ns(0) {
+        if ( out.fail() ) {
+            throw std::runtime_error("Could not open " + filename + " for writing");
+        }
+    }
+
+    Benchmark::~Benchmark() {
+        stop_readers();
+    }
+
+    void Benchmark::start() {
+        start_time = steady_ns();
+        reading = true;
+        for ( int i=0; i<readers; i++ ) {
+            reader_threads.emplace_back([this]() {
+                while ( reading ) {
+                    auto frame = world.snapshot();
+                    if ( frame ) {
+                        std::string text = frame_to_json(*frame);
+                    }
+                    reads++;
+                }
+            });
+        }
+    }
+
+    void Benchmark::stop_readers() {
+        reading = false;
+        for ( auto& t : reader_threads ) {
+            t.join();
+        }
+        if ( !reader_threads.empty() ) {
+            reading_ns = steady_ns() - start_time;
+        }
+        reader_threads.clear();
+    }
+
+    void Benchmark::update() {
+
+        long long t0 = steady_ns();
+        auto frame = world.capture();
+        long long t1 = steady_ns();
+        std::string text = frame_to_json(*frame);
+        long long t2 = steady_ns();
+        StateStream stream(1);
+        stream.publish(frame);
+        binary_bytes = stream.encode(0).size();
+        long long t3 = steady_ns();
+        compact_bytes = encoder.encode(*frame, encoder.table_id(), encoder.table_size(), false).size();
+        long long t4 = steady_ns();
+        quantized_bytes = encoder.encode(*frame, encoder.table_id(), encoder.table_size(), true).size();
+        long long t5 = steady_ns();
+
+        capture_ns.push_back(t1 - t0);
+        json_ns.push_back(t2 - t1);
+        binary_ns.push_back(t3 - t2);
+        compact_ns.push_back(t4 - t3);
+        quantized_ns.push_back(t5 - t4);
+        json_bytes = text.size();
+        agents = frame->agents.size();
+
+    }
+
+    void Benchmark::stop() {
+
+        stop_readers();
+        json profile = world.get_profiler().report();
+        double update_time = profile["phases"]["update"]["total"];
+        auto share = [&](double t) { return update_time > 0 ? t / update_time : 0.0; };
+        json json_time = summary(json_ns),
+             compact_time = summary(compact_ns),
+             quantized_time = summary(quantized_ns);
+        auto per_agent = [&](double x) { return agents > 0 ? x / agents : 0.0; };
+
+        json result = {
+            { "bench", label },
+            { "startup_seconds", startup },
+            { "wall_seconds", ( steady_ns() - start_time ) / 1e9 },
+            { "tick", profile["phases"]["update"] },
+            { "shares", {
+                { "step", share(profile["phases"]["step"]["total"]) },
+                { "controllers", share(profile["phases"]["controllers"]["total"]) },
+                { "sensor", share(profile["work"]["sensor"]["total"]) },
+                { "snapshot", share(profile["phases"]["snapshot"]["total"]) }
+            } },
+            { "serialize", {
+                { "samples", capture_ns.size() },
+                { "capture", summary(capture_ns) },
+                { "json", json_time },
+                { "json_bytes", json_bytes },
+                { "binary", summary(binary_ns) },
+                { "binary_bytes", binary_bytes },
+                { "compact", compact_time },
+                { "compact_bytes", compact_bytes },
+                { "quantized", quantized_time },
+                { "quantized_bytes", quantized_bytes },
+                { "per_agent", {
+                    { "agents", agents },
+                    { "json_ns", per_agent(json_time["p50"].get<double>() * 1e9) },
+                    { "json_bytes", per_agent(json_bytes) },
+                    { "compact_ns", per_agent(compact_time["p50"].get<double>() * 1e9) },
+                    { "compact_bytes", per_agent(compact_bytes) },
+                    { "quantized_ns", per_agent(quantized_time["p50"].get<double>() * 1e9) },
+                    { "quantized_bytes", per_agent(quantized_bytes) }
+                } }
+            } },
+            { "readers", {
+                { "threads", readers },
+                { "reads", reads.load() },
+                { "reads_per_second", reading_ns > 0 ? reads.load() / ( reading_ns / 1e9 ) : 0.0 }
+            } },
+            { "profile", profile }
+        };
+
+        // The worlds of one process may share a results file, and stop on
+        // their own threads
+        static std::mutex writing;
+        std::lock_guard<std::mutex> lock(writing);
+        out << result.dump() << "\n";
+        out.flush();
+
+    }
+
+}
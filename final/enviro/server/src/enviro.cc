@@ -1,9 +1,16 @@
 #include <iostream>
 #include <chrono>
+#include <deque>
+#include <thread>
+#include <pthread.h>
 
 #include "elma/elma.h"
 #include "enviro.h"
 #include "world_server.h"
+#include "state_writer.h"
+#include "recorder.h"
+#include "replay.h"
+#include "benchmark.h"
 
 //! \filee
 
@@ -17,7 +24,112 @@ class DummyState : public State {
     void exit(const Event& e) {}
 };
 
-int main() {
+// The configuration of each world to run. A "worlds" entry in config.json
+// is either a number of identical copies, or a list of objects, each 
+// merged over the rest of the configuration to make one world.
+std::vector<json> world_configs(json config) {
+    json worlds = config.value("worlds", json(1));
+    config.erase("worlds");
+    std::vector<json> result;
+    if ( worlds.is_number_integer() ) {
+        for ( int k=0; k<worlds.get<int>(); k++ ) {
+            result.push_back(config);
+        }
+    } else if ( worlds.is_array() ) {
+        for ( auto& changes : worlds ) {
+            json c = config;
+            c.merge_patch(changes);
+            result.push_back(c);
+        }
+    }
+    if ( result.empty() ) {
+        throw std::runtime_error("\"worlds\" should be a positive number or a list of objects");
+    }
+    return result;
+}
+
+// Adds the world's number to a filename when there are several worlds,
+// so state.jsonl becomes state.0.jsonl, state.1.jsonl and so on.
+std::string numbered(std::string filename, int k, int n) {
+    if ( n == 1 ) {
+        return filename;
+    }
+    size_t dot = filename.rfind('.');
+    if ( dot == std::string::npos || filename.find('/', dot) != std::string::npos ) {
+        dot = filename.size();
+    }
+    return filename.substr(0, dot) + "." + std::to_string(k) + filename.substr(dot);
+}
+
+// Keeps a world's thread on one core, so that worlds do not migrate
+// between cores and evict each other's caches.
+void pin_thread(std::thread& thread, int k) {
+    int cores = std::thread::hardware_concurrency();
+    if ( cores > 0 ) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(k % cores, &set);
+        if ( pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0 ) {
+            std::cerr << "Warning: could not pin world " << k << " to a core\n";
+        }
+    }
+}
+
+void usage() {
+    std::cerr << "usage: enviro [--headless [--steps N | --duration SECONDS] [--every N] [--output FILE] [--bench FILE]] [--record FILE]\n"
+              << "       enviro --replay FILE [--speed X] [--seek SECONDS]\n"
+              << "\n"
+              << "  --headless    step the world in simulated time as fast as possible, without a server\n"
+              << "  --steps N     number of physics steps to run\n"
+              << "  --duration S  simulated seconds to run (default 60)\n"
+              << "  --every N     also write the state every N physics steps (default: final state only)\n"
+              << "  --output FILE where to write state as json lines (default state.jsonl)\n"
+              << "  --bench FILE  headless, and also append a timing report for the run to FILE\n"
+              << "  --record FILE also append the world's state to a binary log, for --replay\n"
+              << "  --replay FILE serve a recorded log to the client instead of running the world\n"
+              << "  --speed X     replay speed, where 1 is as recorded (default 1)\n"
+              << "  --seek S      start the replay S seconds into the recording (default 0)\n";
+}
+
+int main(int argc, char * argv[]) {
+
+    bool headless = false;
+    high_resolution_clock::duration run_time = 60_s;
+    long steps = -1;
+    long every = 0;
+    std::string output = "state.jsonl";
+    std::string record, replay, bench;
+    double speed = 1, seek = 0;
+
+    for ( int i=1; i<argc; i++ ) {
+        std::string arg = argv[i];
+        bool has_value = i+1 < argc;
+        if ( arg == "--headless" ) {
+            headless = true;
+        } else if ( arg == "--steps" && has_value ) {
+            steps = std::stol(argv[++i]);
+        } else if ( arg == "--duration" && has_value ) {
+            run_time = duration_cast<high_resolution_clock::duration>(duration<double>(std::stod(argv[++i])));
+        } else if ( arg == "--every" && has_value ) {
+            every = std::stol(argv[++i]);
+        } else if ( arg == "--output" && has_value ) {
+            output = argv[++i];
+        } else if ( arg == "--bench" && has_value ) {
+            bench = argv[++i];
+            headless = true;
+        } else if ( arg == "--record" && has_value ) {
+            record = argv[++i];
+        } else if ( arg == "--replay" && has_value ) {
+            replay = argv[++i];
+        } else if ( arg == "--speed" && has_value ) {
+            speed = std::stod(argv[++i]);
+        } else if ( arg == "--seek" && has_value ) {
+            seek = std::stod(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
 
     json config = json_helper::read("config.json");
     if ( config["invisibles"].is_null() ) {
@@ -28,35 +140,99 @@ int main() {
     }    
     json_helper::check(config, ENVIRO_CONFIG_SCHEMA);
 
-    Manager m;
-    World world(config, m);
+    if ( replay != "" ) {
+
+        // No world, physics or controllers, just the recorded frames
+        Replay source(replay, config, speed, seek);
+        std::mutex mutex;
+        std::cout << "Replaying " << source.length() << " seconds from " << replay << std::endl;
+        WorldServer(source, mutex, config).run();
+        return 0;
+
+    }
+
+    // One world per entry in "worlds", each with its own manager, run on
+    // its own thread
+    std::vector<json> configs = world_configs(config);
+    int n = configs.size();
+    std::deque<Manager> managers(n);
+    std::vector<std::unique_ptr<World>> worlds;
+    std::vector<std::unique_ptr<Process>> writers;
+    std::vector<high_resolution_clock::duration> run_times;
+
+    for ( int k=0; k<n; k++ ) {
+
+        Manager& m = managers[k];
+        auto building = steady_clock::now();
+        worlds.emplace_back(new World(configs[k], m));
+        double startup = duration<double>(steady_clock::now() - building).count();
+        World& world = *worlds.back();
+        high_resolution_clock::duration world_period = world.get_step_period();
+        run_times.push_back(steps >= 0 ? steps * world_period : run_time);
+
+        if ( record != "" ) {
+            writers.emplace_back(new Recorder(world, numbered(record, k, n)));
+            m.schedule(*writers.back(), configs[k].value("record_period", 20) * 1_ms);
+        }
+
+        if ( headless ) {
+            // Simulated time makes the run deterministic in the number of 
+            // updates each process gets, and lets it go as fast as the CPU
+            // allows.
+            writers.emplace_back(new StateWriter(world, numbered(output, k, n), every > 0));
+            m.schedule(*writers.back(), every > 0 ? every * world_period : run_times[k]);
+            m.use_simulated_time();
+            if ( bench != "" ) {
+                json label = configs[k].value("bench", json::object());
+                if ( n > 1 ) {
+                    label["world"] = k;
+                }
+                // Every world appends to the same file, told apart by label
+                writers.emplace_back(new Benchmark(world, bench, label,
+                                                   configs[k].value("bench_readers", 0), startup));
+                m.schedule(*writers.back(), AGENT_PERIOD);
+            }
+        } else {
+            m.use_real_time()
+             .set_niceness(100_us);
+        }
+
+        // The world updates the agents itself
+        m.schedule(world, world_period);
+        m.init();
+
+    }
+
     StateMachine sm; // This is here just so the enviro executable includes
                      // state machines from libelma.a. Weird.
     DummyState state;
 
-    WorldServer world_server(
-        world,
-        m.get_update_mutex(),
-        config
-    );
-
-    m.use_real_time()
-     .set_niceness(100_us)
-     .schedule(world, 1_ms);
-
-    world.all(
-        [&](Agent& a) { 
-            m.schedule(a, 100_ms);
+    std::vector<std::thread> threads;
+    for ( int k=0; k<n; k++ ) {
+        threads.emplace_back([&, k]() {
+            if ( headless ) {
+                managers[k].run(run_times[k]);
+            } else {
+                managers[k].run();
+            }
+        });
+        if ( n > 1 ) {
+            pin_thread(threads.back(), k);
         }
-    );
+    }
 
-    m.init();
+    if ( !headless ) {
+        WorldServer world_server(*worlds[0], managers[0].get_update_mutex(), config);
+        for ( int k=1; k<n; k++ ) {
+            world_server.add_world(*worlds[k], managers[k].get_update_mutex());
+        }
+        world_server.run();
+    }
 
-    std::thread server_thread([&]() { 
-        world_server.run(); 
-    });
+    for ( auto& t : threads ) {
+        t.join();
+    }
 
-    m.run();
-    server_thread.join();
+    return 0;
      
 }
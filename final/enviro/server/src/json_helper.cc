@@ -1,7 +1,7 @@
 #include <fstream>
 #include <iostream>
 #include <exception>
-#include "json/json.h"
+#include "json_helper.h"
 
 using nlohmann::json;
 
@@ -23,49 +23,138 @@ namespace json_helper {
 
     }
 
-    void check(json object, json schema) {
+    void check(const json& object, const json& schema) {
+        Schema(schema).check(object);
+    }
+
+    Schema::Schema(const json& schema) {
+        compile(schema);
+    }
+
+    // Adds the node for schema, and those for its parts after it, and 
+    // returns its index
+    int Schema::compile(const json& schema) {
+
+        int index = _nodes.size();
+        _nodes.push_back({ ANYTHING, -1, {} });
 
         if ( schema.is_null() ) {
-            if ( ! object.is_null() ) {
-                throw std::runtime_error("JSON Error: Expected null but got " + object.dump() );
-            }
+            _nodes[index].kind = NULL_VALUE;
         } else if ( schema.is_boolean() ) {
-            if ( ! object.is_boolean() ) {
-                throw std::runtime_error("JSON Error: Expected Boolean but got " + object.dump() );
-            }
+            _nodes[index].kind = BOOLEAN;
         } else if ( schema.is_number() ) {
-            if ( ! object.is_number() ) {
-                throw std::runtime_error("JSON Error: Expected number but got " + object.dump() );
-            }
+            _nodes[index].kind = NUMBER;
         } else if ( schema.is_string() ) {
-            if ( ! object.is_string() ) {
-                throw std::runtime_error("JSON Error: Expected string but got " + object.dump());
-            }
+            _nodes[index].kind = STRING;
         } else if ( schema.is_array() ) {
             if ( schema.size() < 1 ) {
                 throw std::runtime_error("JSON Error: Expected at least one element in schema array");
             }
-            if ( object.is_array() ) {
-                for (auto& element : object) {
-                    check(element, schema[0]);
-                }
+            int element = compile(schema[0]);
+            _nodes[index].kind = ARRAY;
+            _nodes[index].element = element;
+        } else if ( schema.is_object() ) {
+            std::vector<std::pair<std::string, int>> keys;
+            for ( auto& [key, value] : schema.items() ) {
+                keys.push_back({ key, compile(value) });
+            }
+            _nodes[index].kind = OBJECT;
+            _nodes[index].keys = std::move(keys);
+        }
+
+        return index;
+
+    }
+
+    void Schema::check(const json& object) const {
+        std::string pointer;
+        check(object, 0, pointer);
+    }
+
+    // Appends a key or index to a JSON pointer, escaping it as in RFC 6901
+    static void push_token(std::string& pointer, const std::string& token) {
+        pointer.push_back('/');
+        for ( char c : token ) {
+            if ( c == '~' ) {
+                pointer.append("~0");
+            } else if ( c == '/' ) {
+                pointer.append("~1");
             } else {
-                throw std::runtime_error("JSON Error: Expected array but got " + object.dump());
+                pointer.push_back(c);
             }
-        } else if ( schema.is_object() ) {
-            if ( object.is_object() ) {
-                for (auto& [key, value] : schema.items()) {
-                    if ( object.find(key) == object.end() ) {
-                        throw std::runtime_error("JSON Error: Expected key '" + key + "' in object " + object.dump());
-                    } else {
-                        check(object[key], value);
+        }
+    }
+
+    static std::string where(const std::string& pointer) {
+        return pointer.empty() ? "the root" : pointer;
+    }
+
+    static void mismatch(const char * expected, const json& object, const std::string& pointer) {
+        std::string found = object.dump();
+        if ( found.size() > 80 ) {
+            found = found.substr(0, 77) + "...";
+        }
+        throw std::runtime_error(std::string("JSON Error: Expected ") + expected + " at " 
+                                 + where(pointer) + " but got " + found);
+    }
+
+    void Schema::check(const json& object, int index, std::string& pointer) const {
+
+        const NODE& node = _nodes[index];
+
+        switch ( node.kind ) {
+
+            case NULL_VALUE:
+                if ( !object.is_null() ) mismatch("null", object, pointer);
+                break;
+
+            case BOOLEAN:
+                if ( !object.is_boolean() ) mismatch("Boolean", object, pointer);
+                break;
+
+            case NUMBER:
+                if ( !object.is_number() ) mismatch("number", object, pointer);
+                break;
+
+            case STRING:
+                if ( !object.is_string() ) mismatch("string", object, pointer);
+                break;
+
+            case ARRAY:
+                if ( !object.is_array() ) {
+                    mismatch("array", object, pointer);
+                } else {
+                    size_t length = pointer.size();
+                    for ( size_t i=0; i<object.size(); i++ ) {
+                        push_token(pointer, std::to_string(i));
+                        check(object[i], node.element, pointer);
+                        pointer.resize(length);
                     }
                 }
-            } else {
-                throw std::runtime_error("JSON Error: Expected object but got " + object.dump());
-            }
-        } 
+                break;
+
+            case OBJECT:
+                if ( !object.is_object() ) {
+                    mismatch("object", object, pointer);
+                } else {
+                    size_t length = pointer.size();
+                    for ( auto& [key, child] : node.keys ) {
+                        auto i = object.find(key);
+                        if ( i == object.end() ) {
+                            throw std::runtime_error("JSON Error: Expected key '" + key + "' in object at " + where(pointer));
+                        }
+                        push_token(pointer, key);
+                        check(*i, child, pointer);
+                        pointer.resize(length);
+                    }
+                }
+                break;
+
+            case ANYTHING:
+                break;
+
+        }
 
     }
 
-};
\ No newline at end of file
+};
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <stdarg.h>
+#include <stdio.h>
+#include <vector>
+#include "profiler.h"
+
+namespace enviro {
+
+    static const char * PHASE_NAMES[NUM_PHASES] = {
+        "constraints", "garbage", "removals", "new_agents",
+        "controllers", "step", "snapshot", "update"
+    };
+
+    static const char * WORK_NAMES[NUM_WORK_KINDS] = {
+        "controller", "sensor"
+    };
+
+    static const double QUANTILES[] = { 0.5, 0.9, 0.99, 1.0 };
+
+    // The histogram bucket of an update that took the given nanoseconds
+    static int bucket(long long ns) {
+        int b = 0;
+        for ( long long us = ns / 1000; us > 0 && b < PROFILE_BUCKETS - 1; us >>= 1 ) {
+            b++;
+        }
+        return b;
+    }
+
+    Profiler::Profiler() : _next(0), _count(0), _sum{}, _histogram{}, _agents(0), _shapes(0), _steps(0) {
+        for ( int k=0; k<NUM_WORK_KINDS; k++ ) {
+            _work_time[k] = 0;
+            _work_count[k] = 0;
+        }
+    }
+
+    void Profiler::commit(const PhaseTimer& timer, int agents, int shapes, unsigned long steps) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for ( int p=0; p<NUM_PHASES; p++ ) {
+            _window[p][_next] = timer.duration((PHASE) p);
+            _sum[p] += timer.duration((PHASE) p);
+        }
+        _histogram[bucket(timer.duration(PHASE_UPDATE))]++;
+        _next = ( _next + 1 ) % PROFILE_WINDOW;
+        _count++;
+        _agents = agents;
+        _shapes = shapes;
+        _steps = steps;
+    }
+
+    static void append(std::string& out, const char * format, ...) __attribute__((format(printf, 2, 3)));
+
+    static void append(std::string& out, const char * format, ...) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int n = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        out.append(buffer, std::min(n, (int) sizeof(buffer) - 1));
+    }
+
+    // The q quantile of a phase over the last n updates, in seconds. Call
+    // with _mutex held.
+    double Profiler::quantile(int phase, int n, double q, std::vector<long long>& window) {
+        if ( n == 0 ) {
+            return 0;
+        }
+        window.assign(_window[phase], _window[phase] + n);
+        std::nth_element(window.begin(), window.begin() + std::min(n - 1, (int) ( q * n )), window.end());
+        return window[std::min(n - 1, (int) ( q * n ))] / 1e9;
+    }
+
+    std::string Profiler::prometheus() {
+
+        std::string out;
+        std::vector<long long> window;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            int n = std::min(_count, (unsigned long long) PROFILE_WINDOW);
+
+            out.append("# HELP enviro_phase_seconds Time spent in each phase of a world update, over the last updates.\n");
+            out.append("# TYPE enviro_phase_seconds summary\n");
+            for ( int p=0; p<NUM_PHASES; p++ ) {
+                for ( double q : QUANTILES ) {
+                    double v = quantile(p, n, q, window);
+                    append(out, "enviro_phase_seconds{phase=\"%s\",quantile=\"%g\"} %.9g\n", PHASE_NAMES[p], q, v);
+                }
+                append(out, "enviro_phase_seconds_sum{phase=\"%s\"} %.9g\n", PHASE_NAMES[p], _sum[p] / 1e9);
+                append(out, "enviro_phase_seconds_count{phase=\"%s\"} %llu\n", PHASE_NAMES[p], _count);
+            }
+
+            out.append("# HELP enviro_update_seconds Time taken by each world update, since the world started.\n");
+            out.append("# TYPE enviro_update_seconds histogram\n");
+            unsigned long long below = 0;
+            for ( int b=0; b<PROFILE_BUCKETS-1; b++ ) {
+                below += _histogram[b];
+                append(out, "enviro_update_seconds_bucket{le=\"%g\"} %llu\n", ( 1LL << b ) / 1e6, below);
+            }
+            append(out, "enviro_update_seconds_bucket{le=\"+Inf\"} %llu\n", _count);
+            append(out, "enviro_update_seconds_sum %.9g\n", _sum[PHASE_UPDATE] / 1e9);
+            append(out, "enviro_update_seconds_count %llu\n", _count);
+
+            out.append("# HELP enviro_agents Agents in the world.\n");
+            out.append("# TYPE enviro_agents gauge\n");
+            append(out, "enviro_agents %d\n", _agents);
+            out.append("# HELP enviro_shapes Collision shapes in the physics space.\n");
+            out.append("# TYPE enviro_shapes gauge\n");
+            append(out, "enviro_shapes %d\n", _shapes);
+            out.append("# HELP enviro_steps_total Physics steps taken.\n");
+            out.append("# TYPE enviro_steps_total counter\n");
+            append(out, "enviro_steps_total %lu\n", _steps);
+        }
+
+        out.append("# HELP enviro_work_seconds_total Time spent in agent controller updates and sensor reads.\n");
+        out.append("# TYPE enviro_work_seconds_total counter\n");
+        for ( int k=0; k<NUM_WORK_KINDS; k++ ) {
+            append(out, "enviro_work_seconds_total{kind=\"%s\"} %.9g\n", WORK_NAMES[k], _work_time[k].load() / 1e9);
+        }
+        out.append("# HELP enviro_work_total Agent controller updates and sensor reads.\n");
+        out.append("# TYPE enviro_work_total counter\n");
+        for ( int k=0; k<NUM_WORK_KINDS; k++ ) {
+            append(out, "enviro_work_total{kind=\"%s\"} %llu\n", WORK_NAMES[k], _work_count[k].load());
+        }
+
+        return out;
+
+    }
+
+    json Profiler::report() {
+
+        json result, phases = json::object(), work = json::object();
+        std::vector<long long> window;
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            int n = std::min(_count, (unsigned long long) PROFILE_WINDOW);
+            for ( int p=0; p<NUM_PHASES; p++ ) {
+                phases[PHASE_NAMES[p]] = {
+                    { "p50", quantile(p, n, 0.5, window) },
+                    { "p90", quantile(p, n, 0.9, window) },
+                    { "p99", quantile(p, n, 0.99, window) },
+                    { "max", quantile(p, n, 1.0, window) },
+                    { "total", _sum[p] / 1e9 }
+                };
+            }
+            // Counts of updates by duration, each under its bound in
+            // microseconds and at least the bound before it
+            json bounds = json::array(), counts = json::array();
+            for ( int b=0; b<PROFILE_BUCKETS; b++ ) {
+                bounds.push_back(b < PROFILE_BUCKETS - 1 ? json(1LL << b) : json(nullptr));
+                counts.push_back(_histogram[b]);
+            }
+            result["histogram"] = { { "under_us", bounds }, { "counts", counts } };
+            result["updates"] = _count;
+            result["agents"] = _agents;
+            result["shapes"] = _shapes;
+            result["steps"] = _steps;
+        }
+
+        for ( int k=0; k<NUM_WORK_KINDS; k++ ) {
+            work[WORK_NAMES[k]] = {
+                { "total", _work_time[k].load() / 1e9 },
+                { "count", _work_count[k].load() }
+            };
+        }
+
+        result["phases"] = phases;
+        result["work"] = work;
+        return result;
+
+    }
+
+}
@@ -0,0 +1,611 @@
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include "raycaster.h"
+#include "enviro.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RAYCAST_HAVE_AVX2
+#endif
+
+// Added around shape boxes before they are put in the grid, in world
+// units, so that rounding never leaves a hit point outside its cells
+#define RAYCAST_PAD 1e-3
+
+// The grid is made coarser than the configured cell size if it would
+// otherwise have more than this many cells per shape (or 4096 in all)
+#define RAYCAST_CELLS_PER_SHAPE 4
+
+namespace enviro {
+
+    // The state of one cast. The best hit so far is the one with the
+    // lowest alpha, then the lowest shape index.
+    typedef struct {
+        cpVect a, b;
+        int64_t group;
+        double alpha;
+        int shape;          // -1 until something is hit
+        bool inside;        // the ray starts inside the shape
+    } RAY;
+
+    static inline void consider(RAY& ray, double alpha, int shape, bool inside) {
+        if ( alpha < ray.alpha || ( alpha == ray.alpha && ray.shape >= 0 && shape < ray.shape ) ) {
+            ray.alpha = alpha;
+            ray.shape = shape;
+            ray.inside = inside;
+        }
+    }
+
+    // The kernels below follow Chipmunk's cpShapeSegmentQuery for a zero
+    // radius: a shape that contains the start of the ray is hit at alpha
+    // 0, and otherwise circles use CircleSegmentQuery and polygons
+    // cpPolySegmentQuery. Each expression is evaluated in the same order
+    // as there, so the results agree to the bit.
+
+    static void circles_scalar(const double * x, const double * y, const double * r, const int64_t * g,
+                               const int * shape, int n, RAY& ray) {
+
+        for ( int i=0; i<n; i++ ) {
+
+            if ( g[i] != 0 && g[i] == ray.group ) {
+                continue;
+            }
+
+            double dax = ray.a.x - x[i], day = ray.a.y - y[i];
+            double dd = dax*dax + day*day;
+            if ( sqrt(dd) - r[i] <= 0 ) {
+                consider(ray, 0, shape[i], true);
+                continue;
+            }
+
+            double dbx = ray.b.x - x[i], dby = ray.b.y - y[i];
+            double de = dax*dbx + day*dby;
+            double ee = dbx*dbx + dby*dby;
+            double qa = dd - 2.0*de + ee;
+            double qb = de - dd;
+            double det = qb*qb - qa*(dd - r[i]*r[i]);
+            if ( det >= 0 ) {
+                double t = (-qb - sqrt(det))/qa;
+                if ( 0 <= t && t <= 1 ) {
+                    consider(ray, t, shape[i], false);
+                }
+            }
+
+        }
+
+    }
+
+    // Returns the alpha at which the polygon is hit, or 1 if it is not
+    static double polygon_scalar(const double * vx, const double * vy, const double * px, const double * py,
+                                 const double * nx, const double * ny, int count, double r, const RAY& ray) {
+
+        double alpha = 1;
+        cpVect a = ray.a, b = ray.b;
+
+        for ( int i=0; i<count; i++ ) {
+            double an = a.x*nx[i] + a.y*ny[i];
+            double d = an - (vx[i]*nx[i] + vy[i]*ny[i]) - r;
+            if ( d < 0 ) {
+                continue;
+            }
+            double bn = b.x*nx[i] + b.y*ny[i];
+            double den = an - bn;
+            double t = d/(den > DBL_MIN ? den : DBL_MIN);
+            if ( t < 0 || 1 < t ) {
+                continue;
+            }
+            double x = a.x*(1 - t) + b.x*t, y = a.y*(1 - t) + b.y*t;
+            double dt = nx[i]*y - ny[i]*x;
+            double dt_min = nx[i]*py[i] - ny[i]*px[i];
+            double dt_max = nx[i]*vy[i] - ny[i]*vx[i];
+            if ( dt_min <= dt && dt <= dt_max ) {
+                alpha = t;
+            }
+        }
+
+        // The rounded corners
+        for ( int i=0; i<count; i++ ) {
+            double dax = a.x - vx[i], day = a.y - vy[i];
+            double dbx = b.x - vx[i], dby = b.y - vy[i];
+            double dd = dax*dax + day*day;
+            double de = dax*dbx + day*dby;
+            double ee = dbx*dbx + dby*dby;
+            double qa = dd - 2.0*de + ee;
+            double qb = de - dd;
+            double det = qb*qb - qa*(dd - r*r);
+            if ( det >= 0 ) {
+                double t = (-qb - sqrt(det))/qa;
+                if ( 0 <= t && t <= 1 && t < alpha ) {
+                    alpha = t;
+                }
+            }
+        }
+
+        return alpha;
+
+    }
+
+    // cpPolyShapePointQuery, as used to decide whether p is inside
+    static bool polygon_contains(const double * vx, const double * vy, const double * px, const double * py,
+                                 const double * nx, const double * ny, int count, double r, cpVect p) {
+
+        double min_dist = INFINITY;
+        bool outside = false;
+
+        for ( int i=0; i<count; i++ ) {
+            outside = outside || ( nx[i]*(p.x - vx[i]) + ny[i]*(p.y - vy[i]) > 0 );
+            double dx = px[i] - vx[i], dy = py[i] - vy[i];
+            double f = (dx*(p.x - vx[i]) + dy*(p.y - vy[i]))/(dx*dx + dy*dy);
+            f = f < 1.0 ? f : 1.0;
+            f = 0.0 > f ? 0.0 : f;
+            double cx = vx[i] + dx*f, cy = vy[i] + dy*f;
+            double dist = sqrt((p.x - cx)*(p.x - cx) + (p.y - cy)*(p.y - cy));
+            if ( dist < min_dist ) {
+                min_dist = dist;
+            }
+        }
+
+        return ( outside ? min_dist : -min_dist ) - r <= 0;
+
+    }
+
+#ifdef RAYCAST_HAVE_AVX2
+
+    // The same, four circles or edges at a time. Lanes past the end of the
+    // data read padding and are masked off.
+
+    __attribute__((target("avx2")))
+    static void circles_avx2(const double * x, const double * y, const double * r, const int64_t * g,
+                             const int * shape, int n, RAY& ray) {
+
+        const __m256d ax = _mm256_set1_pd(ray.a.x), ay = _mm256_set1_pd(ray.a.y);
+        const __m256d bx = _mm256_set1_pd(ray.b.x), by = _mm256_set1_pd(ray.b.y);
+        const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0), two = _mm256_set1_pd(2.0);
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        const __m256i group = _mm256_set1_epi64x(ray.group), no_group = _mm256_setzero_si256();
+
+        for ( int i=0; i<n; i+=4 ) {
+
+            __m256i gi = _mm256_loadu_si256((const __m256i *) (g + i));
+            __m256i same = _mm256_andnot_si256(_mm256_cmpeq_epi64(gi, no_group), _mm256_cmpeq_epi64(gi, group));
+            int live = ~_mm256_movemask_pd(_mm256_castsi256_pd(same)) & ( ( 1 << std::min(4, n - i) ) - 1 );
+            if ( !live ) {
+                continue;
+            }
+
+            __m256d cx = _mm256_loadu_pd(x + i), cy = _mm256_loadu_pd(y + i), cr = _mm256_loadu_pd(r + i);
+            __m256d dax = _mm256_sub_pd(ax, cx), day = _mm256_sub_pd(ay, cy);
+            __m256d dd = _mm256_add_pd(_mm256_mul_pd(dax, dax), _mm256_mul_pd(day, day));
+            int inside = live & _mm256_movemask_pd(_mm256_cmp_pd(_mm256_sub_pd(_mm256_sqrt_pd(dd), cr), zero, _CMP_LE_OQ));
+
+            __m256d dbx = _mm256_sub_pd(bx, cx), dby = _mm256_sub_pd(by, cy);
+            __m256d de = _mm256_add_pd(_mm256_mul_pd(dax, dbx), _mm256_mul_pd(day, dby));
+            __m256d ee = _mm256_add_pd(_mm256_mul_pd(dbx, dbx), _mm256_mul_pd(dby, dby));
+            __m256d qa = _mm256_add_pd(_mm256_sub_pd(dd, _mm256_mul_pd(two, de)), ee);
+            __m256d qb = _mm256_sub_pd(de, dd);
+            __m256d det = _mm256_sub_pd(_mm256_mul_pd(qb, qb), _mm256_mul_pd(qa, _mm256_sub_pd(dd, _mm256_mul_pd(cr, cr))));
+            __m256d t = _mm256_div_pd(_mm256_sub_pd(_mm256_xor_pd(qb, sign), _mm256_sqrt_pd(det)), qa);
+            __m256d hit = _mm256_and_pd(_mm256_cmp_pd(det, zero, _CMP_GE_OQ),
+                          _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GE_OQ), _mm256_cmp_pd(t, one, _CMP_LE_OQ)));
+            int hits = live & ~inside & _mm256_movemask_pd(hit);
+
+            if ( inside | hits ) {
+                double alpha[4];
+                _mm256_storeu_pd(alpha, t);
+                for ( int k=0; k<4; k++ ) {
+                    if ( inside & ( 1 << k ) ) {
+                        consider(ray, 0, shape[i+k], true);
+                    } else if ( hits & ( 1 << k ) ) {
+                        consider(ray, alpha[k], shape[i+k], false);
+                    }
+                }
+            }
+
+        }
+
+    }
+
+    __attribute__((target("avx2")))
+    static double polygon_avx2(const double * vx, const double * vy, const double * px, const double * py,
+                               const double * nx, const double * ny, int count, double r, const RAY& ray) {
+
+        const __m256d ax = _mm256_set1_pd(ray.a.x), ay = _mm256_set1_pd(ray.a.y);
+        const __m256d bx = _mm256_set1_pd(ray.b.x), by = _mm256_set1_pd(ray.b.y);
+        const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0), two = _mm256_set1_pd(2.0);
+        const __m256d sign = _mm256_set1_pd(-0.0), tiny = _mm256_set1_pd(DBL_MIN);
+        const __m256d rr = _mm256_set1_pd(r), none = _mm256_set1_pd(INFINITY);
+
+        double alpha = 1;
+        double t_lanes[4];
+
+        // Where several edges match, the last one wins, as in Chipmunk
+        for ( int i=0; i<count; i+=4 ) {
+            int live = ( 1 << std::min(4, count - i) ) - 1;
+            __m256d nnx = _mm256_loadu_pd(nx + i), nny = _mm256_loadu_pd(ny + i);
+            __m256d vvx = _mm256_loadu_pd(vx + i), vvy = _mm256_loadu_pd(vy + i);
+            __m256d an = _mm256_add_pd(_mm256_mul_pd(ax, nnx), _mm256_mul_pd(ay, nny));
+            __m256d vn = _mm256_add_pd(_mm256_mul_pd(vvx, nnx), _mm256_mul_pd(vvy, nny));
+            __m256d d = _mm256_sub_pd(_mm256_sub_pd(an, vn), rr);
+            __m256d bn = _mm256_add_pd(_mm256_mul_pd(bx, nnx), _mm256_mul_pd(by, nny));
+            __m256d t = _mm256_div_pd(d, _mm256_max_pd(_mm256_sub_pd(an, bn), tiny));
+            __m256d u = _mm256_sub_pd(one, t);
+            __m256d x = _mm256_add_pd(_mm256_mul_pd(ax, u), _mm256_mul_pd(bx, t));
+            __m256d y = _mm256_add_pd(_mm256_mul_pd(ay, u), _mm256_mul_pd(by, t));
+            __m256d dt = _mm256_sub_pd(_mm256_mul_pd(nnx, y), _mm256_mul_pd(nny, x));
+            __m256d dt_min = _mm256_sub_pd(_mm256_mul_pd(nnx, _mm256_loadu_pd(py + i)), _mm256_mul_pd(nny, _mm256_loadu_pd(px + i)));
+            __m256d dt_max = _mm256_sub_pd(_mm256_mul_pd(nnx, vvy), _mm256_mul_pd(nny, vvx));
+            __m256d match = _mm256_and_pd(
+                _mm256_and_pd(_mm256_cmp_pd(d, zero, _CMP_GE_OQ),
+                              _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GE_OQ), _mm256_cmp_pd(t, one, _CMP_LE_OQ))),
+                _mm256_and_pd(_mm256_cmp_pd(dt_min, dt, _CMP_LE_OQ), _mm256_cmp_pd(dt, dt_max, _CMP_LE_OQ)));
+            int matches = live & _mm256_movemask_pd(match);
+            if ( matches ) {
+                _mm256_storeu_pd(t_lanes, t);
+                alpha = t_lanes[31 - __builtin_clz(matches)];
+            }
+        }
+
+        // The rounded corners, keeping the earliest hit
+        __m256d corner = none;
+        for ( int i=0; i<count; i+=4 ) {
+            __m256d live = _mm256_castsi256_pd(_mm256_cmpgt_epi64(
+                _mm256_set1_epi64x(count - i), _mm256_setr_epi64x(0, 1, 2, 3)));
+            __m256d vvx = _mm256_loadu_pd(vx + i), vvy = _mm256_loadu_pd(vy + i);
+            __m256d dax = _mm256_sub_pd(ax, vvx), day = _mm256_sub_pd(ay, vvy);
+            __m256d dbx = _mm256_sub_pd(bx, vvx), dby = _mm256_sub_pd(by, vvy);
+            __m256d dd = _mm256_add_pd(_mm256_mul_pd(dax, dax), _mm256_mul_pd(day, day));
+            __m256d de = _mm256_add_pd(_mm256_mul_pd(dax, dbx), _mm256_mul_pd(day, dby));
+            __m256d ee = _mm256_add_pd(_mm256_mul_pd(dbx, dbx), _mm256_mul_pd(dby, dby));
+            __m256d qa = _mm256_add_pd(_mm256_sub_pd(dd, _mm256_mul_pd(two, de)), ee);
+            __m256d qb = _mm256_sub_pd(de, dd);
+            __m256d det = _mm256_sub_pd(_mm256_mul_pd(qb, qb), _mm256_mul_pd(qa, _mm256_sub_pd(dd, _mm256_mul_pd(rr, rr))));
+            __m256d t = _mm256_div_pd(_mm256_sub_pd(_mm256_xor_pd(qb, sign), _mm256_sqrt_pd(det)), qa);
+            __m256d hit = _mm256_and_pd(live, _mm256_and_pd(_mm256_cmp_pd(det, zero, _CMP_GE_OQ),
+                          _mm256_and_pd(_mm256_cmp_pd(t, zero, _CMP_GE_OQ), _mm256_cmp_pd(t, one, _CMP_LE_OQ))));
+            corner = _mm256_min_pd(corner, _mm256_blendv_pd(none, t, hit));
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, corner);
+        double nearest = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+        if ( nearest < alpha ) {
+            alpha = nearest;
+        }
+
+        return alpha;
+
+    }
+
+#endif
+
+    Raycaster::Raycaster()
+        : _space(NULL),
+          _kernel(RAYCAST_CHIPMUNK),
+          _cell_size(64),
+          _fresh(false),
+          _moved(false),
+          _x0(0),
+          _y0(0),
+          _cell(64),
+          _columns(0),
+          _rows(0) {}
+
+    void Raycaster::configure(cpSpace * space, const std::string& mode, double cell_size) {
+
+        if ( cell_size <= 0 ) {
+            throw std::runtime_error("raycast_cell_size must be positive");
+        }
+
+        _space = space;
+        _cell_size = cell_size;
+        _fresh = false;
+
+        if ( mode == "chipmunk" ) {
+            _kernel = RAYCAST_CHIPMUNK;
+        } else if ( mode == "scalar" ) {
+            _kernel = RAYCAST_SCALAR;
+        } else if ( mode == "auto" ) {
+            _kernel = RAYCAST_SCALAR;
+#ifdef RAYCAST_HAVE_AVX2
+            if ( __builtin_cpu_supports("avx2") ) {
+                _kernel = RAYCAST_AVX2;
+            }
+#endif
+        } else {
+            throw std::runtime_error("sensor_raycast must be \"auto\", \"scalar\" or \"chipmunk\"");
+        }
+
+    }
+
+    // Copies a shape's world coordinates the way Chipmunk caches them
+    // (cpShapeUpdate), from its body's transform and its local geometry.
+    void Raycaster::add_shape(cpShape * shape) {
+
+        cpShapeFilter filter = cpShapeGetFilter(shape);
+        if ( cpShapeGetSensor(shape) || !( filter.categories & AGENT_SENSOR_CATEGORY ) || !( CP_ALL_CATEGORIES & filter.mask ) ) {
+            return;
+        }
+
+        cpBody * body = cpShapeGetBody(shape);
+        Agent * agent = (Agent *) cpBodyGetUserData(body);
+        cpVect rot = cpBodyGetRotation(body);
+        cpTransform t = { rot.x, rot.y, -rot.y, rot.x, 0, 0 };
+        cpVect origin = cpBodyLocalToWorld(body, cpvzero);
+        t.tx = origin.x;
+        t.ty = origin.y;
+
+        SHAPE s;
+        s.circle = agent->parameters().shape != AGENT_SHAPE_POLYGON;
+        s.is_static = cpBodyGetType(body) == CP_BODY_TYPE_STATIC;
+        s.group = filter.group;
+        s.type = agent->get_type_id();
+        s.first = _vx.size();
+        s.count = 0;
+
+        if ( s.circle ) {
+
+            cpVect c = cpCircleShapeGetOffset(shape);
+            s.x = t.a*c.x + t.c*c.y + t.tx;
+            s.y = t.b*c.x + t.d*c.y + t.ty;
+            s.r = cpCircleShapeGetRadius(shape);
+            s.bb = cpBBNew(s.x - s.r, s.y - s.r, s.x + s.r, s.y + s.r);
+
+        } else {
+
+            int n = cpPolyShapeGetCount(shape);
+            s.count = n;
+            s.r = cpPolyShapeGetRadius(shape);
+            s.bb = cpBBNew(INFINITY, INFINITY, -INFINITY, -INFINITY);
+
+            for ( int i=0; i<n; i++ ) {
+
+                // Edge normals as in cpPolyShape's SetVerts
+                cpVect a = cpPolyShapeGetVert(shape, (i - 1 + n) % n);
+                cpVect b = cpPolyShapeGetVert(shape, i);
+                cpVect e = cpvrperp(cpvsub(b, a));
+                cpVect normal = cpvmult(e, 1.0/(sqrt(cpvdot(e, e)) + DBL_MIN));
+
+                double x = t.a*b.x + t.c*b.y + t.tx, y = t.b*b.x + t.d*b.y + t.ty;
+                _vx.push_back(x);
+                _vy.push_back(y);
+                _nx.push_back(t.a*normal.x + t.c*normal.y);
+                _ny.push_back(t.b*normal.x + t.d*normal.y);
+                s.bb.l = std::min(s.bb.l, x);
+                s.bb.b = std::min(s.bb.b, y);
+                s.bb.r = std::max(s.bb.r, x);
+                s.bb.t = std::max(s.bb.t, y);
+
+            }
+
+            for ( int i=0; i<n; i++ ) {
+                _px.push_back(_vx[s.first + (i - 1 + n) % n]);
+                _py.push_back(_vy[s.first + (i - 1 + n) % n]);
+            }
+            while ( _vx.size() % 4 ) {
+                for ( auto v : { &_vx, &_vy, &_px, &_py, &_nx, &_ny } ) {
+                    v->push_back(0);
+                }
+            }
+
+            s.bb = cpBBNew(s.bb.l - s.r, s.bb.b - s.r, s.bb.r + s.r, s.bb.t + s.r);
+
+        }
+
+        s.bb = cpBBNew(s.bb.l - RAYCAST_PAD, s.bb.b - RAYCAST_PAD, s.bb.r + RAYCAST_PAD, s.bb.t + RAYCAST_PAD);
+        _shapes.push_back(s);
+
+    }
+
+    void Raycaster::refresh() {
+
+        _shapes.clear();
+        for ( auto v : { &_vx, &_vy, &_px, &_py, &_nx, &_ny } ) {
+            v->clear();
+        }
+
+        cpSpaceEachShape(_space, [](cpShape * shape, void * data) {
+            ((Raycaster *) data)->add_shape(shape);
+        }, this);
+
+        // Chipmunk queries static shapes before the others
+        std::stable_partition(_shapes.begin(), _shapes.end(), [](const SHAPE& s) { return s.is_static; });
+
+        build_grid();
+
+    }
+
+    void Raycaster::build_grid() {
+
+        _circle_start.assign(1, 0);
+        _polygon_start.assign(1, 0);
+        _cx.clear(); _cy.clear(); _cr.clear(); _cgroup.clear();
+        _circle_shape.clear();
+        _polygon_shape.clear();
+        _columns = _rows = 0;
+
+        if ( _shapes.empty() ) {
+            return;
+        }
+
+        cpBB box = _shapes[0].bb;
+        for ( auto& s : _shapes ) {
+            box = cpBBNew(std::min(box.l, s.bb.l), std::min(box.b, s.bb.b), std::max(box.r, s.bb.r), std::max(box.t, s.bb.t));
+        }
+
+        double limit = std::max(4096.0, (double) RAYCAST_CELLS_PER_SHAPE * _shapes.size());
+        _cell = _cell_size;
+        while ( ( floor((box.r - box.l) / _cell) + 1 ) * ( floor((box.t - box.b) / _cell) + 1 ) > limit ) {
+            _cell *= 1.5;
+        }
+        _x0 = box.l;
+        _y0 = box.b;
+        _columns = floor((box.r - box.l) / _cell) + 1;
+        _rows = floor((box.t - box.b) / _cell) + 1;
+
+        auto column = [this](double x) { return std::max(0, std::min(_columns - 1, (int) floor((x - _x0) / _cell))); };
+        auto row = [this](double y) { return std::max(0, std::min(_rows - 1, (int) floor((y - _y0) / _cell))); };
+
+        // Count the entries in each cell, then fill them in shape order
+        int cells = _columns * _rows;
+        std::vector<int> circles(cells + 1, 0), polygons(cells + 1, 0);
+        for ( auto& s : _shapes ) {
+            auto& count = s.circle ? circles : polygons;
+            for ( int j = row(s.bb.b); j <= row(s.bb.t); j++ ) {
+                for ( int i = column(s.bb.l); i <= column(s.bb.r); i++ ) {
+                    count[j * _columns + i + 1]++;
+                }
+            }
+        }
+        for ( int c=0; c<cells; c++ ) {
+            circles[c+1] += circles[c];
+            polygons[c+1] += polygons[c];
+        }
+        _circle_start = circles;
+        _polygon_start = polygons;
+
+        // Padding lets the kernels load whole vectors at the end
+        _cx.resize(circles[cells] + 4, 0);
+        _cy.resize(circles[cells] + 4, 0);
+        _cr.resize(circles[cells] + 4, 0);
+        _cgroup.resize(circles[cells] + 4, 0);
+        _circle_shape.resize(circles[cells] + 4, -1);
+        _polygon_shape.resize(polygons[cells]);
+
+        for ( int k=0; k<(int) _shapes.size(); k++ ) {
+            auto& s = _shapes[k];
+            for ( int j = row(s.bb.b); j <= row(s.bb.t); j++ ) {
+                for ( int i = column(s.bb.l); i <= column(s.bb.r); i++ ) {
+                    int c = j * _columns + i;
+                    if ( s.circle ) {
+                        int e = circles[c]++;
+                        _cx[e] = s.x;
+                        _cy[e] = s.y;
+                        _cr[e] = s.r;
+                        _cgroup[e] = (int64_t) s.group;
+                        _circle_shape[e] = k;
+                    } else {
+                        _polygon_shape[polygons[c]++] = k;
+                    }
+                }
+            }
+        }
+
+    }
+
+    // Clips the segment's parameter range [t0, t1] to lo <= a + t d <= hi
+    static bool clip(double a, double d, double lo, double hi, double& t0, double& t1) {
+        if ( d == 0 ) {
+            return lo <= a && a <= hi;
+        }
+        double ta = (lo - a) / d, tb = (hi - a) / d;
+        if ( ta > tb ) {
+            std::swap(ta, tb);
+        }
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        return t0 <= t1;
+    }
+
+    bool Raycaster::cast(cpVect start, cpVect end, cpGroup group, RAYCAST_HIT& hit) {
+
+        if ( !_fresh ) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if ( !_fresh ) {
+                refresh();
+                _fresh = true;
+            }
+        }
+
+        RAY ray = { start, end, (int64_t) group, 1, -1, false };
+
+        double dx = end.x - start.x, dy = end.y - start.y;
+        double t0 = 0, t1 = 1;
+        if ( _columns == 0 ||
+             !clip(start.x, dx, _x0, _x0 + _columns * _cell, t0, t1) ||
+             !clip(start.y, dy, _y0, _y0 + _rows * _cell, t0, t1) ) {
+            return false;
+        }
+
+        // Walk the cells along the ray, stopping once the best hit so far
+        // is clearly inside the cells already visited
+        double length = sqrt(dx*dx + dy*dy);
+        double slack = length > 0 ? 0.5 * RAYCAST_PAD / length : 0;
+
+        int ix = std::max(0, std::min(_columns - 1, (int) floor((start.x + dx * t0 - _x0) / _cell)));
+        int iy = std::max(0, std::min(_rows - 1, (int) floor((start.y + dy * t0 - _y0) / _cell)));
+        int sx = dx > 0 ? 1 : -1, sy = dy > 0 ? 1 : -1;
+        double next_x = dx != 0 ? (_x0 + ( ix + ( dx > 0 ) ) * _cell - start.x) / dx : INFINITY;
+        double next_y = dy != 0 ? (_y0 + ( iy + ( dy > 0 ) ) * _cell - start.y) / dy : INFINITY;
+        double step_x = dx != 0 ? _cell / fabs(dx) : INFINITY;
+        double step_y = dy != 0 ? _cell / fabs(dy) : INFINITY;
+
+        while ( true ) {
+
+            int c = iy * _columns + ix;
+
+            int first = _circle_start[c], n = _circle_start[c+1] - first;
+            if ( n > 0 ) {
+#ifdef RAYCAST_HAVE_AVX2
+                if ( _kernel == RAYCAST_AVX2 ) {
+                    circles_avx2(&_cx[first], &_cy[first], &_cr[first], &_cgroup[first], &_circle_shape[first], n, ray);
+                } else
+#endif
+                circles_scalar(&_cx[first], &_cy[first], &_cr[first], &_cgroup[first], &_circle_shape[first], n, ray);
+            }
+
+            for ( int e = _polygon_start[c]; e < _polygon_start[c+1]; e++ ) {
+                int k = _polygon_shape[e];
+                const SHAPE& s = _shapes[k];
+                if ( s.group != 0 && (int64_t) s.group == ray.group ) {
+                    continue;
+                }
+                int f = s.first;
+                if ( s.bb.l <= start.x && start.x <= s.bb.r && s.bb.b <= start.y && start.y <= s.bb.t &&
+                     polygon_contains(&_vx[f], &_vy[f], &_px[f], &_py[f], &_nx[f], &_ny[f], s.count, s.r, start) ) {
+                    consider(ray, 0, k, true);
+                    continue;
+                }
+                double alpha;
+#ifdef RAYCAST_HAVE_AVX2
+                if ( _kernel == RAYCAST_AVX2 ) {
+                    alpha = polygon_avx2(&_vx[f], &_vy[f], &_px[f], &_py[f], &_nx[f], &_ny[f], s.count, s.r, ray);
+                } else
+#endif
+                alpha = polygon_scalar(&_vx[f], &_vy[f], &_px[f], &_py[f], &_nx[f], &_ny[f], s.count, s.r, ray);
+                consider(ray, alpha, k, false);
+            }
+
+            double exit = std::min(next_x, next_y);
+            if ( ( ray.shape >= 0 && ray.alpha < exit - slack ) || exit >= t1 ) {
+                break;
+            }
+            if ( next_x < next_y ) {
+                ix += sx;
+                next_x += step_x;
+                if ( ix < 0 || ix >= _columns ) {
+                    break;
+                }
+            } else {
+                iy += sy;
+                next_y += step_y;
+                if ( iy < 0 || iy >= _rows ) {
+                    break;
+                }
+            }
+
+        }
+
+        if ( ray.shape < 0 ) {
+            return false;
+        }
+
+        // As in cpShapeSegmentQuery, a ray that starts inside a shape hits
+        // it at its far end
+        hit.alpha = ray.alpha;
+        hit.point = ray.inside ? end : cpvlerp(start, end, ray.alpha);
+        hit.type = _shapes[ray.shape].type;
+        return true;
+
+    }
+
+}
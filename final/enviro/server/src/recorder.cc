@@ -0,0 +1,111 @@
+#include "recorder.h"
+#include "bytes.h"
+
+namespace enviro {
+
+    RecordWriter::RecordWriter(std::string filename) {
+        out = fopen(filename.c_str(), "wb");
+        if ( out == NULL ) {
+            throw std::runtime_error("Could not open " + filename + " for writing");
+        }
+        std::string header = RECORD_MAGIC;
+        put_u32(header, RECORD_VERSION);
+        fwrite(header.data(), 1, header.size(), out);
+    }
+
+    RecordWriter::~RecordWriter() {
+        fclose(out);
+    }
+
+    void RecordWriter::write(uint8_t kind, const std::string& payload) {
+        std::string prefix;
+        put_u8(prefix, kind);
+        put_u32(prefix, payload.size());
+        fwrite(prefix.data(), 1, prefix.size(), out);
+        fwrite(payload.data(), 1, payload.size(), out);
+    }
+
+    uint32_t RecordWriter::intern(const std::string& s) {
+        auto i = strings.find(s);
+        if ( i != strings.end() ) {
+            return i->second;
+        }
+        uint32_t index = strings.size();
+        strings[s] = index;
+        std::string payload;
+        put_u32(payload, index);
+        payload.append(s);
+        write(RECORD_STRING, payload);
+        return index;
+    }
+
+    // Specifications are shared between frames until an agent's style
+    // changes, so they are looked up by pointer before by content.
+    uint32_t RecordWriter::intern(const std::shared_ptr<const std::string>& s) {
+        auto i = shared_strings.find(s);
+        if ( i != shared_strings.end() ) {
+            return i->second;
+        }
+        return shared_strings[s] = intern(*s);
+    }
+
+    void RecordWriter::write(const WORLD_FRAME& frame, double time) {
+
+        // Table entries go before the frame that uses them
+        std::vector<uint32_t> indices;
+        for ( auto& a : frame.agents ) {
+            indices.push_back(intern(a.specification));
+            indices.push_back(intern(a.decoration));
+            indices.push_back(intern(a.label));
+        }
+
+        entry.clear();
+        put_f64(entry, time);
+        put_u32(entry, frame.timestamp);
+        put_f32(entry, frame.center_x);
+        put_f32(entry, frame.center_y);
+        put_f32(entry, frame.zoom);
+        put_u32(entry, frame.agents.size());
+
+        int k = 0;
+        for ( auto& a : frame.agents ) {
+            put_u32(entry, a.id);
+            put_u32(entry, indices[k++]);
+            put_f32(entry, a.x);
+            put_f32(entry, a.y);
+            put_f32(entry, a.theta);
+            put_f32(entry, a.vx);
+            put_f32(entry, a.vy);
+            put_f32(entry, a.omega);
+            put_u32(entry, indices[k++]);
+            put_u32(entry, indices[k++]);
+            put_f32(entry, a.label_x);
+            put_f32(entry, a.label_y);
+            put_u8(entry, a.sensors.size());
+            for ( double s : a.sensors ) {
+                put_f32(entry, s);
+            }
+        }
+
+        write(RECORD_FRAME, entry);
+
+    }
+
+    void RecordWriter::flush() {
+        fflush(out);
+    }
+
+    Recorder::Recorder(World& world, std::string filename)
+        : Process("Recorder"),
+          world(world),
+          writer(filename) {}
+
+    void Recorder::update() {
+        writer.write(*world.capture(), milli_time());
+    }
+
+    void Recorder::stop() {
+        writer.flush();
+    }
+
+}
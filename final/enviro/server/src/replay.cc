@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "replay.h"
+#include "recorder.h"
+#include "bytes.h"
+#include "static_object.h"
+
+namespace enviro {
+
+    static long long steady_ms() {
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    Replay::Replay(std::string filename, json config, double speed, double seek)
+        : config(config),
+          current(-1),
+          number(0) {
+
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat info;
+        if ( fd < 0 || fstat(fd, &info) != 0 ) {
+            throw std::runtime_error("Could not open " + filename);
+        }
+        size = info.st_size;
+        void * map = size == 0 ? MAP_FAILED : mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if ( map == MAP_FAILED ) {
+            throw std::runtime_error("Could not map " + filename);
+        }
+        data = (const unsigned char *) map;
+
+        ByteReader reader(data, size);
+        std::string magic((const char *) reader.bytes(8), 8);
+        if ( magic != RECORD_MAGIC || reader.u32() != RECORD_VERSION ) {
+            munmap((void *) data, size);
+            throw std::runtime_error(filename + " is not an enviro recording, or is from another version");
+        }
+
+        // Index the log. A run that was killed may have left a partial
+        // entry at the end, which is ignored.
+        try {
+            while ( !reader.done() ) {
+                uint8_t kind = reader.u8();
+                uint32_t n = reader.u32();
+                size_t offset = reader.position();
+                const unsigned char * payload = reader.bytes(n);
+                if ( kind == RECORD_STRING ) {
+                    ByteReader entry(payload, n);
+                    entry.u32(); // strings are numbered in order
+                    strings.push_back(std::make_shared<const std::string>((const char *) payload + 4, n - 4));
+                } else if ( kind == RECORD_FRAME ) {
+                    frames.push_back(offset);
+                    lengths.push_back(n);
+                    times.push_back(ByteReader(payload, n).f64());
+                }
+            }
+        } catch ( const std::runtime_error& e ) {
+            std::cerr << "Warning: " << filename << " ends with an incomplete entry\n";
+        }
+
+        if ( frames.empty() ) {
+            munmap((void *) data, size);
+            throw std::runtime_error(filename + " has no frames");
+        }
+
+        double first = times[0];
+        for ( auto& t : times ) {
+            t -= first;
+        }
+
+        // Statics are not recorded. They come from the configuration,
+        // as they do for a live world.
+        if ( !this->config["statics"].is_array() ) {
+            this->config["statics"] = json::array();
+        }
+
+        set_playback(speed, seek);
+
+    }
+
+    Replay::~Replay() {
+        munmap((void *) data, size);
+    }
+
+    double Replay::length() const {
+        return times.back() / 1000;
+    }
+
+    double Replay::position() {
+        return origin + ( steady_ms() - start_time ) * speed;
+    }
+
+    void Replay::set_playback(double new_speed, double seek) {
+        origin = std::max(0.0, std::min(seek * 1000, times.back()));
+        start_time = steady_ms();
+        speed = std::max(0.0, new_speed);
+    }
+
+    void Replay::handle_event(const Event& e) {
+        if ( e.name() == "replay" ) {
+            json v = e.value();
+            double p = position() / 1000;
+            set_playback(v.value("speed", speed), v.value("seek", p));
+        }
+    }
+
+    std::shared_ptr<const WORLD_FRAME> Replay::snapshot() {
+
+        // The last frame recorded at or before the playback position
+        auto i = std::upper_bound(times.begin(), times.end(), position());
+        int index = std::max(0, (int) ( i - times.begin() ) - 1);
+
+        if ( index != current ) {
+            frame = decode(index);
+            current = index;
+        }
+        return frame;
+
+    }
+
+    std::shared_ptr<const WORLD_FRAME> Replay::decode(int index) {
+
+        ByteReader reader(data + frames[index], lengths[index]);
+        auto f = std::make_shared<WORLD_FRAME>();
+
+        // Frames are renumbered as they are shown, so that numbers keep
+        // increasing when playback seeks backward.
+        if ( ++number == 0 ) {
+            number = 1;
+        }
+        f->number = number;
+        reader.f64();
+        f->timestamp = reader.u32();
+        f->center_x = reader.f32();
+        f->center_y = reader.f32();
+        f->zoom = reader.f32();
+        f->interpolation = 0;
+
+        auto string = [&](uint32_t k) -> std::shared_ptr<const std::string> {
+            if ( k >= strings.size() ) {
+                throw std::runtime_error("Recording refers to a missing string");
+            }
+            return strings[k];
+        };
+
+        uint32_t n = reader.u32();
+        f->agents.resize(n);
+        for ( auto& a : f->agents ) {
+            a.id = reader.u32();
+            uint32_t k = reader.u32();
+            a.specification = string(k);
+            std::tie(a.definition, a.style) = split(k);
+            a.x = reader.f32();
+            a.y = reader.f32();
+            a.theta = reader.f32();
+            a.vx = reader.f32();
+            a.vy = reader.f32();
+            a.omega = reader.f32();
+            a.decoration = *string(reader.u32());
+            a.label = *string(reader.u32());
+            a.label_x = reader.f32();
+            a.label_y = reader.f32();
+            a.bounds = { a.x, a.y, a.x, a.y }; // not recorded
+            int num_sensors = reader.u8();
+            for ( int j=0; j<num_sensors; j++ ) {
+                a.sensors.push_back(reader.f32());
+            }
+        }
+
+        return f;
+
+    }
+
+    // The definition and style of a recorded specification, parsed out of
+    // it the first time a frame refers to it
+    const Replay::SPECIFICATION_PARTS& Replay::split(uint32_t k) {
+        auto i = parts.find(k);
+        if ( i == parts.end() ) {
+            try {
+                json spec = json::parse(*strings[k]);
+                i = parts.emplace(k, SPECIFICATION_PARTS(
+                    std::make_shared<const std::string>(spec.at("definition").dump()),
+                    std::make_shared<const std::string>(spec.value("style", json::object()).dump()))).first;
+            } catch ( const json::exception& e ) {
+                throw std::runtime_error("Recording has an invalid agent specification");
+            }
+        }
+        return i->second;
+    }
+
+    std::string Replay::metrics() {
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer),
+            "# HELP enviro_replay_position_seconds Playback position in the recording.\n"
+            "# TYPE enviro_replay_position_seconds gauge\n"
+            "enviro_replay_position_seconds %.3f\n"
+            "# HELP enviro_replay_length_seconds Length of the recording.\n"
+            "# TYPE enviro_replay_length_seconds gauge\n"
+            "enviro_replay_length_seconds %.3f\n",
+            std::min(position(), times.back()) / 1000, length());
+        return buffer;
+    }
+
+}
@@ -0,0 +1,100 @@
+#include <chrono>
+#include <stdexcept>
+#include <stdio.h>
+#include <zlib.h>
+#include "response_cache.h"
+
+namespace enviro {
+
+    using namespace std::chrono;
+
+    static long long steady_ns() {
+        return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    ResponseCache::ResponseCache()
+        : _frame(0),
+          _hits(0),
+          _misses(0),
+          _serialize_ns(0),
+          _compress_ns(0) {}
+
+    std::shared_ptr<const std::string> ResponseCache::get(uint32_t frame, const std::string& key, bool gzip,
+                                                          const std::function<std::string()>& serialize) {
+
+        if ( frame != _frame ) {
+            _responses.clear();
+            _gzipped.clear();
+            _frame = frame;
+        }
+
+        auto& responses = gzip ? _gzipped : _responses;
+        auto i = responses.find(key);
+        if ( i != responses.end() ) {
+            _hits++;
+            return i->second;
+        }
+        _misses++;
+
+        // A compressed response is made from the plain one, which may
+        // already be cached for clients that do not accept gzip
+        std::shared_ptr<const std::string> response;
+        auto p = _responses.find(key);
+        if ( p != _responses.end() ) {
+            response = p->second;
+        } else {
+            long long t0 = steady_ns();
+            response = std::make_shared<const std::string>(serialize());
+            _serialize_ns += steady_ns() - t0;
+            _responses.emplace(key, response);
+        }
+        if ( gzip ) {
+            long long t0 = steady_ns();
+            response = std::make_shared<const std::string>(enviro::gzip(*response));
+            _compress_ns += steady_ns() - t0;
+            _gzipped.emplace(key, response);
+        }
+        return response;
+
+    }
+
+    std::string ResponseCache::metrics() const {
+        char buffer[1024];
+        snprintf(buffer, sizeof(buffer),
+            "# HELP enviro_state_responses_total Responses to /state, by whether they were already serialized for the frame.\n"
+            "# TYPE enviro_state_responses_total counter\n"
+            "enviro_state_responses_total{cache=\"hit\"} %llu\n"
+            "enviro_state_responses_total{cache=\"miss\"} %llu\n"
+            "# HELP enviro_state_seconds_total Time spent serializing and compressing /state responses.\n"
+            "# TYPE enviro_state_seconds_total counter\n"
+            "enviro_state_seconds_total{kind=\"serialize\"} %.9g\n"
+            "enviro_state_seconds_total{kind=\"compress\"} %.9g\n",
+            _hits, _misses, _serialize_ns / 1e9, _compress_ns / 1e9);
+        return buffer;
+    }
+
+    std::string gzip(const std::string& text) {
+
+        z_stream z = {};
+        // 15 window bits, plus 16 for a gzip header and trailer
+        if ( deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK ) {
+            throw std::runtime_error("Could not initialize zlib");
+        }
+
+        std::string out(deflateBound(&z, text.size()), '\0');
+        z.next_in = (Bytef *) text.data();
+        z.avail_in = text.size();
+        z.next_out = (Bytef *) &out[0];
+        z.avail_out = out.size();
+        int status = deflate(&z, Z_FINISH);
+        out.resize(z.total_out);
+        deflateEnd(&z);
+
+        if ( status != Z_STREAM_END ) {
+            throw std::runtime_error("Could not compress a response");
+        }
+        return out;
+
+    }
+
+}
@@ -8,10 +8,17 @@ cpVect rotate(cpVect v, cpFloat theta) {
     };
 }
 
-std::pair<double,std::string> RangeSensor::value() {
+std::pair<double,std::string> Sensor::value() {
+    SENSOR_READING r = read();
+    if ( r.type == SENSOR_NOTHING ) {
+        return std::make_pair(r.distance, std::string("None"));
+    }
+    return std::make_pair(r.distance, _agent_ptr->get_world_ptr()->type_name(r.type));
+}
+
+SENSOR_READING RangeSensor::read() {
 
-    double distance = 10000;
-    std::string reflection_type = "None";
+    SENSOR_READING r = { 10000, SENSOR_NOTHING };
 
     World * world = _agent_ptr->get_world_ptr();
 
@@ -23,27 +30,43 @@ std::pair<double,std::string> RangeSensor::value() {
     cpFloat angle = _angle + _agent_ptr->angle();              
     cpVect end = cpvadd(start, { x: 1000 * cos(angle), y: 1000 * sin(angle)});       
 
-    world->all([&](Agent& other ) {
+    // First-hit segment queries only read the space, so parallel controllers
+    // can share it as long as nobody adds to it at the same time.
+    std::shared_lock<std::shared_mutex> lock(world->get_space_mutex(), std::defer_lock);
+    if ( world->in_parallel_phase() ) {
+        lock.lock();
+    }
 
-        if ( &other != _agent_ptr && 
-             other.definition()["type"] != "noninteractive" &&
-             other.definition()["type"] != "invisible" ) {
+    // The world's raycaster gives the same answer as the space, faster,
+    // except just after a teleport
+    Raycaster& raycaster = world->get_raycaster();
+    if ( raycaster.usable() ) {
+        RAYCAST_HIT hit;
+        if ( raycaster.cast(start, end, _agent_ptr->get_shape_group(), hit) ) {
+            r.distance = cpvdist(start, hit.point);
+            r.type = hit.type;
+        }
+        return r;
+    }
 
-            cpSegmentQueryInfo info;        
-            cpShape * shape = other.get_shape();
-            cpShapeSegmentQuery(shape, start, end, 0, &info);
+    // Ask the space's spatial index for the nearest shape along the ray. The
+    // filter skips the sensing agent's own shape (its group) and anything not
+    // in the sensor category. Noninteractive and invisible agents never have
+    // shapes in the space, so they are not seen either.
+    cpShapeFilter filter = cpShapeFilterNew(
+        _agent_ptr->get_shape_group(), 
+        CP_ALL_CATEGORIES, 
+        AGENT_SENSOR_CATEGORY);
 
-            if ( info.shape != NULL ) {
-                double d = cpvdist(start, info.point);
-                if ( d < distance ) {
-                    distance = d;
-                    reflection_type = other.name();
-                }
-            }
-        }
-        
-    });
+    cpSegmentQueryInfo info;
+    cpShape * shape = cpSpaceSegmentQueryFirst(world->get_space(), start, end, 0, filter, &info);
+
+    if ( shape != NULL ) {
+        Agent * other = (Agent *) cpBodyGetUserData(cpShapeGetBody(shape));
+        r.distance = cpvdist(start, info.point);
+        r.type = other->get_type_id();
+    }
 
-    return std::make_pair(distance,reflection_type);
+    return r;
 
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include "state_encoder.h"
+#include "bytes.h"
+
+namespace enviro {
+
+    // Used for records that do not carry a definition or style
+    static const std::shared_ptr<const std::string> NO_DEFINITION = std::make_shared<const std::string>("null");
+    static const std::shared_ptr<const std::string> NO_STYLE = std::make_shared<const std::string>("{}");
+
+    // The number of steps from origin to v, rounded and clamped to [lo, hi].
+    // Values that are not finite are sent as zero steps.
+    static long steps(double v, double origin, double step, long lo, long hi) {
+        if ( !isfinite(v) || step <= 0 ) {
+            return 0;
+        }
+        double q = round(( v - origin ) / step);
+        return q < lo ? lo : ( q > hi ? hi : (long) q );
+    }
+
+    // The largest finite magnitude in a list of values
+    static void extend(double& m, double v) {
+        if ( isfinite(v) ) {
+            m = std::max(m, fabs(v));
+        }
+    }
+
+    StateEncoder::StateEncoder() {
+        // A fresh id for each run, so that a client that survives a server
+        // restart does not mistake the new table for the one it holds.
+        std::random_device device;
+        do {
+            _table_id = device();
+        } while ( _table_id == 0 );
+    }
+
+    uint32_t StateEncoder::intern(const std::shared_ptr<const std::string>& s) {
+
+        auto p = _by_pointer.find(s.get());
+        if ( p != _by_pointer.end() ) {
+            return p->second.second;
+        }
+
+        uint32_t index;
+        auto t = _by_text.find(*s);
+        if ( t != _by_text.end() ) {
+            index = t->second;
+        } else {
+            index = _strings.size();
+            _strings.push_back(s);
+            _by_text.emplace(*s, index);
+        }
+
+        if ( _by_pointer.size() >= 4 * STATE_TABLE_LIMIT ) {
+            _by_pointer.clear();
+        }
+        _by_pointer.emplace(s.get(), std::make_pair(s, index));
+        return index;
+
+    }
+
+    std::string StateEncoder::encode(const WORLD_FRAME& frame, uint32_t table, uint32_t known, bool quantize,
+                                     const BOUNDS * viewport) {
+
+        if ( _strings.size() >= STATE_TABLE_LIMIT ) {
+            _strings.clear();
+            _by_pointer.clear();
+            _by_text.clear();
+            if ( ++_table_id == 0 ) {
+                _table_id = 1;
+            }
+        }
+
+        // The agents to send and their table entries, interned before the
+        // entries the client is missing are written
+        std::vector<const AGENT_RECORD *> agents;
+        std::vector<uint32_t> entries;
+        agents.reserve(frame.agents.size());
+        entries.reserve(2 * frame.agents.size());
+        size_t num_sensors = 0, num_labels = 0;
+        for ( auto& a : frame.agents ) {
+            if ( viewport && !overlaps(a.bounds, *viewport) ) {
+                continue;
+            }
+            agents.push_back(&a);
+            entries.push_back(intern(a.definition ? a.definition : NO_DEFINITION));
+            entries.push_back(intern(a.style ? a.style : NO_STYLE));
+            num_sensors += a.sensors.size();
+            if ( !a.decoration.empty() || !a.label.empty() || a.label_x != 0 || a.label_y != 0 ) {
+                num_labels++;
+            }
+        }
+
+        uint32_t first = table == _table_id && known <= _strings.size() ? known : 0;
+
+        // Quantization ranges. Positions span the frame's bounding box in
+        // 65535 steps, and velocities and sensors their largest magnitudes.
+        double x0 = 0, y0 = 0, dp = 0, dv = 0, dw = 0, ds = 0;
+        if ( quantize && !agents.empty() ) {
+            double x1 = 0, y1 = 0;
+            bool any = false;
+            for ( auto a : agents ) {
+                if ( isfinite(a->x) && isfinite(a->y) ) {
+                    if ( !any ) {
+                        x0 = x1 = a->x;
+                        y0 = y1 = a->y;
+                        any = true;
+                    }
+                    x0 = std::min(x0, a->x);
+                    x1 = std::max(x1, a->x);
+                    y0 = std::min(y0, a->y);
+                    y1 = std::max(y1, a->y);
+                }
+                extend(dv, a->vx);
+                extend(dv, a->vy);
+                extend(dw, a->omega);
+                for ( double s : a->sensors ) {
+                    extend(ds, s);
+                }
+            }
+            // The origin and steps are sent as floats, so they are rounded
+            // to floats before the values are measured against them
+            x0 = (float) x0;
+            y0 = (float) y0;
+            dp = (float) ( std::max(x1 - x0, y1 - y0) / 65535 );
+            dv = (float) ( dv / 32767 );
+            dw = (float) ( dw / 32767 );
+            ds = (float) ( ds / 65535 );
+        }
+
+        std::string out;
+        out.reserve(72 + agents.size() * ( quantize ? 25 : 37 ) + num_sensors * ( quantize ? 2 : 4 ) + num_labels * 32);
+
+        put_u8(out, STATE_FORMAT_VERSION);
+        put_u8(out, quantize ? STATE_QUANTIZED : 0);
+        put_u32(out, _table_id);
+        put_u32(out, frame.number);
+        put_u32(out, frame.timestamp);
+        put_f32(out, frame.center_x);
+        put_f32(out, frame.center_y);
+        put_f32(out, frame.zoom);
+        put_f32(out, frame.interpolation);
+        if ( quantize ) {
+            put_f32(out, x0);
+            put_f32(out, y0);
+            put_f32(out, dp);
+            put_f32(out, dv);
+            put_f32(out, dw);
+            put_f32(out, ds);
+        }
+
+        put_u32(out, first);
+        put_u32(out, _strings.size() - first);
+        for ( size_t i=first; i<_strings.size(); i++ ) {
+            put_string(out, *_strings[i]);
+        }
+
+        put_u32(out, agents.size());
+        for ( size_t i=0; i<agents.size(); i++ ) {
+            auto a = agents[i];
+            put_u32(out, a->id);
+            put_u32(out, entries[2*i]);
+            put_u32(out, entries[2*i+1]);
+            if ( quantize ) {
+                double theta = isfinite(a->theta) ? a->theta - 2 * M_PI * floor(a->theta / ( 2 * M_PI )) : 0;
+                put_u16(out, steps(a->x, x0, dp, 0, 65535));
+                put_u16(out, steps(a->y, y0, dp, 0, 65535));
+                put_u16(out, steps(theta, 0, 2 * M_PI / 65536, 0, 65536) & 0xffff);
+                put_u16(out, (uint16_t) steps(a->vx, 0, dv, -32767, 32767));
+                put_u16(out, (uint16_t) steps(a->vy, 0, dv, -32767, 32767));
+                put_u16(out, (uint16_t) steps(a->omega, 0, dw, -32767, 32767));
+            } else {
+                put_f32(out, a->x);
+                put_f32(out, a->y);
+                put_f32(out, a->theta);
+                put_f32(out, a->vx);
+                put_f32(out, a->vy);
+                put_f32(out, a->omega);
+            }
+        }
+
+        for ( auto a : agents ) {
+            size_t n = std::min(a->sensors.size(), (size_t) 255);
+            put_u8(out, n);
+            for ( size_t j=0; j<n; j++ ) {
+                if ( quantize ) {
+                    put_u16(out, steps(a->sensors[j], 0, ds, 0, 65535));
+                } else {
+                    put_f32(out, a->sensors[j]);
+                }
+            }
+        }
+
+        put_u32(out, num_labels);
+        for ( size_t i=0; i<agents.size(); i++ ) {
+            auto a = agents[i];
+            if ( !a->decoration.empty() || !a->label.empty() || a->label_x != 0 || a->label_y != 0 ) {
+                put_u32(out, i);
+                put_f32(out, a->label_x);
+                put_f32(out, a->label_y);
+                put_string(out, a->decoration);
+                put_string(out, a->label);
+            }
+        }
+
+        return out;
+
+    }
+
+}
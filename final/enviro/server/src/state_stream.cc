@@ -0,0 +1,297 @@
+#include <math.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include "json/json.h"
+#include "state_stream.h"
+#include "bytes.h"
+
+namespace enviro {
+
+    static bool differ(double a, double b) {
+        return (float) a != (float) b;
+    }
+
+    static uint8_t changed_fields(const AGENT_RECORD& a, const AGENT_RECORD& b) {
+        uint8_t mask = 0;
+        if ( differ(a.x, b.x) || differ(a.y, b.y) || differ(a.theta, b.theta) ) {
+            mask |= STREAM_POSE;
+        }
+        if ( differ(a.vx, b.vx) || differ(a.vy, b.vy) || differ(a.omega, b.omega) ) {
+            mask |= STREAM_VELOCITY;
+        }
+        if ( a.sensors.size() != b.sensors.size() ) {
+            mask |= STREAM_SENSORS;
+        } else {
+            for ( int i=0; i<a.sensors.size(); i++ ) {
+                if ( differ(a.sensors[i], b.sensors[i]) ) {
+                    mask |= STREAM_SENSORS;
+                    break;
+                }
+            }
+        }
+        if ( a.specification != b.specification && *a.specification != *b.specification ) {
+            mask |= STREAM_SPECIFICATION;
+        }
+        if ( a.decoration != b.decoration ) {
+            mask |= STREAM_DECORATION;
+        }
+        if ( a.label != b.label || differ(a.label_x, b.label_x) || differ(a.label_y, b.label_y) ) {
+            mask |= STREAM_LABEL;
+        }
+        return mask;
+    }
+
+    static void put_agent(std::string& out, const AGENT_RECORD& a, uint8_t mask) {
+        put_u32(out, a.id);
+        put_u8(out, mask);
+        if ( mask & STREAM_POSE ) {
+            put_f32(out, a.x);
+            put_f32(out, a.y);
+            put_f32(out, a.theta);
+        }
+        if ( mask & STREAM_VELOCITY ) {
+            put_f32(out, a.vx);
+            put_f32(out, a.vy);
+            put_f32(out, a.omega);
+        }
+        if ( mask & STREAM_SENSORS ) {
+            put_u8(out, a.sensors.size());
+            for ( double s : a.sensors ) {
+                put_f32(out, s);
+            }
+        }
+        if ( mask & STREAM_SPECIFICATION ) {
+            put_string(out, *a.specification);
+        }
+        if ( mask & STREAM_DECORATION ) {
+            put_string(out, a.decoration);
+        }
+        if ( mask & STREAM_LABEL ) {
+            put_f32(out, a.label_x);
+            put_f32(out, a.label_y);
+            put_string(out, a.label);
+        }
+    }
+
+    bool StateStream::publish(std::shared_ptr<const WORLD_FRAME> frame) {
+        if ( !frame || frame->number == latest() ) {
+            return false;
+        }
+        _history.push_back(frame);
+        while ( _history.size() > _history_size ) {
+            _history.pop_front();
+        }
+        _encoded.clear();
+        return true;
+    }
+
+    std::shared_ptr<const WORLD_FRAME> StateStream::find(uint32_t number) const {
+        for ( auto& f : _history ) {
+            if ( f->number == number ) {
+                return f;
+            }
+        }
+        return nullptr;
+    }
+
+    const std::string& StateStream::encode(uint32_t baseline) {
+        auto base = baseline == 0 ? nullptr : find(baseline);
+        uint32_t key = base ? baseline : 0;
+        auto i = _encoded.find(key);
+        if ( i == _encoded.end() ) {
+            i = _encoded.emplace(key, encode(*_history.back(), base.get())).first;
+        }
+        return i->second;
+    }
+
+    // Layout (all little-endian):
+    //
+    //   u8 version, u8 flags, u32 frame, u32 baseline,
+    //   f32 center x, f32 center y, f32 zoom, u32 timestamp, f32 interpolation,
+    //   u32 number of updates, u32 number of removals,
+    //   updates: u32 id, u8 field mask, then the fields in mask bit order
+    //   removals: u32 id
+    //
+    // Strings are a u32 byte count followed by UTF-8 bytes, and sensors are
+    // a u8 count followed by that many f32 values.
+    std::string StateStream::encode(const WORLD_FRAME& current, const WORLD_FRAME * baseline) const {
+
+        std::string updates, removals;
+        uint32_t num_updates = 0, num_removals = 0;
+
+        if ( baseline == NULL ) {
+            for ( auto& a : current.agents ) {
+                put_agent(updates, a, STREAM_ALL_FIELDS);
+                num_updates++;
+            }
+        } else {
+            // Both agent lists are sorted by id, so one merge pass finds new,
+            // changed and removed agents.
+            auto i = current.agents.begin();
+            auto j = baseline->agents.begin();
+            while ( i != current.agents.end() || j != baseline->agents.end() ) {
+                if ( j == baseline->agents.end() || ( i != current.agents.end() && i->id < j->id ) ) {
+                    put_agent(updates, *i, STREAM_ALL_FIELDS);
+                    num_updates++;
+                    i++;
+                } else if ( i == current.agents.end() || j->id < i->id ) {
+                    put_u32(removals, j->id);
+                    num_removals++;
+                    j++;
+                } else {
+                    uint8_t mask = changed_fields(*i, *j);
+                    if ( mask ) {
+                        put_agent(updates, *i, mask);
+                        num_updates++;
+                    }
+                    i++;
+                    j++;
+                }
+            }
+        }
+
+        std::string out;
+        out.reserve(38 + updates.size() + removals.size());
+        put_u8(out, STREAM_FORMAT_VERSION);
+        put_u8(out, baseline == NULL ? STREAM_KEYFRAME : 0);
+        put_u32(out, current.number);
+        put_u32(out, baseline == NULL ? 0 : baseline->number);
+        put_f32(out, current.center_x);
+        put_f32(out, current.center_y);
+        put_f32(out, current.zoom);
+        put_u32(out, current.timestamp);
+        put_f32(out, current.interpolation);
+        put_u32(out, num_updates);
+        put_u32(out, num_removals);
+        out.append(updates);
+        out.append(removals);
+        return out;
+
+    }
+
+    static void put_number(std::string& out, double v) {
+        if ( isfinite(v) ) {
+            char buffer[32];
+            int n = snprintf(buffer, sizeof(buffer), "%.10g", v);
+            out.append(buffer, n);
+        } else {
+            out.append("null");
+        }
+    }
+
+    static void put_json_string(std::string& out, const std::string& s) {
+        out.append(nlohmann::json(s).dump());
+    }
+
+    // The document is written directly rather than through nlohmann::json
+    // so that each agent's specification, which is already json text, is
+    // spliced in without being parsed and dumped again.
+    std::string frame_to_json(const WORLD_FRAME& frame, const BOUNDS * viewport) {
+
+        std::string out;
+        out.reserve(viewport ? 4096 : 256 * ( frame.agents.size() + 1 ));
+
+        out.append("{\"result\":\"ok\",\"timestamp\":");
+        out.append(std::to_string(frame.timestamp));
+        out.append(",\"agents\":[");
+
+        bool first = true;
+        for ( auto& a : frame.agents ) {
+            if ( viewport && !overlaps(a.bounds, *viewport) ) {
+                continue;
+            }
+            if ( !first ) {
+                out.push_back(',');
+            }
+            first = false;
+            out.append("{\"id\":");
+            out.append(std::to_string(a.id));
+            out.append(",\"position\":{\"x\":");
+            put_number(out, a.x);
+            out.append(",\"y\":");
+            put_number(out, a.y);
+            out.append(",\"theta\":");
+            put_number(out, a.theta);
+            out.append("},\"velocity\":{\"x\":");
+            put_number(out, a.vx);
+            out.append(",\"y\":");
+            put_number(out, a.vy);
+            out.append(",\"theta\":");
+            put_number(out, a.omega);
+            out.append("},\"specification\":");
+            out.append(*a.specification);
+            out.append(",\"sensors\":[");
+            for ( int i=0; i<a.sensors.size(); i++ ) {
+                if ( i > 0 ) {
+                    out.push_back(',');
+                }
+                put_number(out, a.sensors[i]);
+            }
+            out.append("],\"decoration\":");
+            put_json_string(out, a.decoration);
+            out.append(",\"label\":{\"text\":");
+            put_json_string(out, a.label);
+            out.append(",\"x\":");
+            put_number(out, a.label_x);
+            out.append(",\"y\":");
+            put_number(out, a.label_y);
+            out.append("}}");
+        }
+
+        out.append("],\"center\":{\"x\":");
+        put_number(out, frame.center_x);
+        out.append(",\"y\":");
+        put_number(out, frame.center_y);
+        out.append("},\"zoom\":");
+        put_number(out, frame.zoom);
+        out.append(",\"interpolation\":");
+        put_number(out, frame.interpolation);
+        out.append("}");
+
+        return out;
+
+    }
+
+    bool query_parameter(std::string_view query, std::string_view name, std::string& value) {
+
+        if ( !query.empty() && query[0] == '?' ) {
+            query.remove_prefix(1);
+        }
+
+        while ( !query.empty() ) {
+            size_t end = query.find('&');
+            std::string_view pair = query.substr(0, end);
+            query = end == std::string_view::npos ? std::string_view() : query.substr(end + 1);
+            if ( pair.size() > name.size() && pair.substr(0, name.size()) == name && pair[name.size()] == '=' ) {
+                value = pair.substr(name.size() + 1);
+                return true;
+            }
+        }
+
+        return false;
+
+    }
+
+    bool parse_viewport(std::string_view query, double margin, BOUNDS& viewport) {
+
+        std::string value;
+        if ( !query_parameter(query, "view", value) ) {
+            return false;
+        }
+
+        // Commas may arrive escaped as %2C
+        size_t p;
+        while ( ( p = value.find("%2") ) != std::string::npos && p + 2 < value.size() && toupper(value[p+2]) == 'C' ) {
+            value.replace(p, 3, ",");
+        }
+        double l, b, r, t;
+        if ( sscanf(value.c_str(), "%lf,%lf,%lf,%lf", &l, &b, &r, &t) != 4 || !( l <= r && b <= t ) ) {
+            return false;
+        }
+        viewport = { l - margin, b - margin, r + margin, t + margin };
+        return true;
+
+    }
+
+}
@@ -0,0 +1,30 @@
+#include "state_writer.h"
+
+namespace enviro {
+
+    StateWriter::StateWriter(World& world, std::string filename, bool periodic)
+        : Process("StateWriter"),
+          world(world),
+          out(filename),
+          periodic(periodic) {
+        if ( out.fail() ) {
+            throw std::runtime_error("Could not open " + filename + " for writing");
+        }
+    }
+
+    void StateWriter::update() {
+        if ( periodic ) {
+            write();
+        }
+    }
+
+    void StateWriter::stop() {
+        write();
+        out.flush();
+    }
+
+    void StateWriter::write() {
+        out << frame_to_json(*world.capture()) << "\n";
+    }
+
+}
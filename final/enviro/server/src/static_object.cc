@@ -28,4 +28,4 @@ json StaticObject::build_specification(json static_entry) {
 
     return result;
 
-}
\ No newline at end of file
+}
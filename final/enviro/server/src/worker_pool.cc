@@ -0,0 +1,84 @@
+#include <algorithm>
+#include "worker_pool.h"
+
+// Iterations are handed out in chunks of this size to keep contention on
+// the shared counter low
+#define WORKER_POOL_CHUNK 16
+
+namespace enviro {
+
+    WorkerPool::WorkerPool(int size) : _count(0), _busy(0), _batch(0), _quit(false) {
+        for ( int i=1; i<size; i++ ) {
+            _threads.push_back(std::thread([this]() { work(); }));
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _quit = true;
+        }
+        _start.notify_all();
+        for ( auto& t : _threads ) {
+            t.join();
+        }
+    }
+
+    void WorkerPool::parallel_for(int count, std::function<void(int)> f) {
+
+        if ( _threads.empty() || count <= WORKER_POOL_CHUNK ) {
+            for ( int i=0; i<count; i++ ) {
+                f(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _job = f;
+            _count = count;
+            _next = 0;
+            _busy = _threads.size();
+            _batch++;
+        }
+        _start.notify_all();
+
+        run_batch();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this]() { return _busy == 0; });
+        _job = nullptr;
+
+    }
+
+    void WorkerPool::run_batch() {
+        int i;
+        while ( ( i = _next.fetch_add(WORKER_POOL_CHUNK) ) < _count ) {
+            int end = std::min(i + WORKER_POOL_CHUNK, _count);
+            for ( ; i < end; i++ ) {
+                _job(i);
+            }
+        }
+    }
+
+    void WorkerPool::work() {
+        unsigned long seen = 0;
+        while ( true ) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _start.wait(lock, [&]() { return _quit || _batch != seen; });
+                if ( _quit ) {
+                    return;
+                }
+                seen = _batch;
+            }
+            run_batch();
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _busy--;
+            }
+            _done.notify_one();
+        }
+    }
+
+}
@@ -1,27 +1,75 @@
 #include <exception>
+#include <math.h>
+#include <algorithm>
+#include <ctime>
 #include <dlfcn.h>
 #include "enviro.h"
 
+// Snapshots are published every snapshot_period ms while they are being
+// read, and once nobody has read one for this long, only every
+// SNAPSHOT_IDLE_PERIOD ms, so that the next reader still gets a recent one
+#define SNAPSHOT_DEMAND_WINDOW 1000
+#define SNAPSHOT_IDLE_PERIOD ( SNAPSHOT_DEMAND_WINDOW / 4 )
+
+// Slack, in ms, for the step period having been rounded to clock ticks
+#define STEP_PERIOD_SLACK 1e-6
+
 namespace enviro {
 
+    static long long steady_ms() {
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
     World::World(json config, Manager& m) 
       : Process("World"), 
+        step_count(0),
+        shape_count(0),
+        accumulator(0),
+        last_step_time(0),
+        interpolation(0),
         config(config), 
         manager_ptr(&m),
         center_x(0),
         center_y(0),
-        zoom(1) {
+        zoom(1),
+        parallel_phase(false),
+        next_controller_time(0),
+        latest_snapshot(std::make_shared<const WORLD_FRAME>(WORLD_FRAME { 0, 0, 0, 1, 0, 0, {} })),
+        snapshot_demand(0),
+        last_snapshot_time(0),
+        snapshot_number(0),
+        snapshot_period(config.value("snapshot_period", 10)) {
+
+        if ( config.value("controller_threads", 0) > 1 ) {
+            workers.reset(new WorkerPool(config["controller_threads"].get<int>()));
+        }
 
         space = cpSpaceNew();
-        timeStep = 1.0/60.0; // TODO: move to config.json
+        time_step = config.value("time_step", 1.0/60.0);
+        steps_per_second = config.value("steps_per_second", 1000.0);
+        substeps = config.value("substeps", 1);
+        max_catch_up_steps = config.value("max_catch_up_steps", 5);
+        if ( time_step <= 0 || steps_per_second <= 0 || substeps < 1 || max_catch_up_steps < 1 ) {
+            throw std::runtime_error("time_step and steps_per_second must be positive, and substeps and max_catch_up_steps at least 1");
+        }
         set_name(config["name"]);
 
+        raycaster.configure(
+            space,
+            config.value("sensor_raycast", std::string("auto")),
+            config.value("raycast_cell_size", 64.0));
+
+        // Each definition file is read once, however many agents use it
+        std::vector<json> entries;
+        for ( auto& list : { config["agents"], config["references"], config["invisibles"] } ) {
+            entries.insert(entries.end(), list.begin(), list.end());
+        }
+        Agent::preload_definitions(entries);
+
         for ( auto agent_entry : config["agents"] ) {
             json spec = Agent::build_specification(agent_entry);
             AGENT_TYPE * at = add_agent_type(spec);
-            auto agent_ptr = at->create_agent(spec, *this); 
-            agent_ptr->set_destroyer(at->destroy_agent);
-            add_agent(*agent_ptr);
+            add_agent(*create_agent(at, spec));
         }
 
         for ( auto agent_entry : config["references"] ) {
@@ -32,16 +80,24 @@ namespace enviro {
         for ( auto agent_entry : config["invisibles"] ) {
             json spec = Agent::build_specification(agent_entry);
             AGENT_TYPE * at = add_agent_type(spec);
-            auto agent_ptr = at->create_agent(spec, *this); 
-            agent_ptr->set_destroyer(at->destroy_agent);
-            add_agent(*agent_ptr);
+            add_agent(*create_agent(at, spec));
         }            
 
+        // Statics never move or run, so they are added to the space once
+        // and sent to clients with the configuration instead of in frames
+        json baked = json::array();
         for ( auto static_entry : config["statics"] ) {
             json spec = StaticObject::build_specification(static_entry);
             auto agent_ptr = new StaticObject(spec, *this);
-            add_agent(*agent_ptr);
-        }        
+            statics.push_back(agent_ptr);
+            shape_count++;
+            baked.push_back({
+                { "id", agent_ptr->get_id() },
+                { "shape", static_entry["shape"] },
+                { "style", static_entry["style"] }
+            });
+        }
+        this->config["statics"] = baked;
 
     }
 
@@ -51,15 +107,27 @@ namespace enviro {
             throw std::runtime_error("Could not add new agent. Unknown type.");
         } 
 
+        // The definition is shared with the type rather than copied
         auto at = agent_types[name];
-        json new_spec = at->specification;
-        new_spec["position"]["x"] = x;
-        new_spec["position"]["y"] = y;
-        new_spec["position"]["theta"] = theta;
-        new_spec["style"] = style;
-
-        auto agent_ptr = at->create_agent(new_spec, *this); 
-        agent_ptr->set_destroyer(at->destroy_agent);
+        json new_spec = {
+            { "definition", name },
+            { "position", { { "x", x }, { "y", y }, { "theta", theta } } },
+            { "style", style }
+        };
+
+        // While controllers run in parallel, an agent one of them spawns is
+        // registered under the lock, but kept out of the space and not
+        // started until they have all finished, so that the others see the
+        // world as it was when the phase began
+        if ( parallel_phase ) {
+            std::unique_lock<std::shared_mutex> lock(space_mutex);
+            auto agent_ptr = create_agent(at, new_spec);
+            agent_ptr->_deferred = true;
+            spawned.push_back(agent_ptr);
+            return *agent_ptr;
+        }
+
+        auto agent_ptr = create_agent(at, new_spec);
         new_agents.push_back(agent_ptr);
         agent_ptr->set_manager(manager_ptr);
         agent_ptr->init(); 
@@ -77,14 +145,35 @@ namespace enviro {
         } else {
             auto file = spec["definition"]["controller"].get<std::string>();
             at = new AGENT_TYPE;
-            at->specification = spec;
-            at->handle = dlopen(file.c_str() , RTLD_LAZY);
-            if (!at->handle) {
-                std::cerr << "Error: " << file << "\n";
-                throw std::runtime_error(dlerror());
+            at->id = intern_type(name);
+            at->definition = std::make_shared<const json>(spec["definition"]);
+            at->definition_text = std::make_shared<const std::string>(at->definition->dump());
+            at->params = Agent::decode_parameters(*at->definition);
+            at->vertices = Agent::bake_vertices(*at->definition);
+            const AGENT_FACTORY * factory = AgentRegistry::find(file);
+            if ( factory ) {
+                // Compiled into this executable
+                at->handle = NULL;
+                at->create_agent = factory->create_agent;
+                at->destroy_agent = factory->destroy_agent;
+                at->agent_size = factory->agent_size;
+                at->construct_agent = factory->construct_agent;
+                at->destruct_agent = factory->destruct_agent;
+            } else {
+                at->handle = dlopen(file.c_str() , RTLD_LAZY);
+                if (!at->handle) {
+                    std::cerr << "Error: " << file << "\n";
+                    throw std::runtime_error(dlerror());
+                }
+                at->create_agent = AGENT_CREATE_TYPE dlsym(at->handle, "create_agent");
+                at->destroy_agent = AGENT_DESTROY_TYPE dlsym(at->handle, "destroy_agent");
+                at->agent_size = AGENT_SIZE_TYPE dlsym(at->handle, "agent_size");
+                at->construct_agent = AGENT_CONSTRUCT_TYPE dlsym(at->handle, "construct_agent");
+                at->destruct_agent = AGENT_DESTROY_TYPE dlsym(at->handle, "destruct_agent");
+                if ( !at->agent_size || !at->construct_agent || !at->destruct_agent ) {
+                    at->construct_agent = NULL; // built with an older DECLARE_INTERFACE
+                }
             }
-            at->create_agent = AGENT_CREATE_TYPE dlsym(at->handle, "create_agent");
-            at->destroy_agent = AGENT_DESTROY_TYPE dlsym(at->handle, "destroy_agent");
             agent_types[name] = at;
         } 
 
@@ -92,10 +181,97 @@ namespace enviro {
 
     }    
 
+    AGENT_TYPE * World::get_agent_type(const std::string& name) {
+        auto i = agent_types.find(name);
+        if ( i == agent_types.end() ) {
+            throw std::runtime_error("Unknown agent type " + name);
+        }
+        return i->second;
+    }
+
+    // Builds an agent of the given type from a specification whose
+    // definition is the type's name, in recycled storage when the type's
+    // plugin supports it.
+    Agent * World::create_agent(AGENT_TYPE * at, const json& spec) {
+
+        json instance = spec;
+        instance["definition"] = at->definition->at("name");
+
+        if ( !at->construct_agent ) {
+            Agent * agent_ptr = at->create_agent(instance, *this);
+            agent_ptr->set_destroyer(at->destroy_agent);
+            return agent_ptr;
+        }
+
+        void * memory;
+        if ( at->free_storage.empty() ) {
+            memory = ::operator new(at->agent_size());
+        } else {
+            memory = at->free_storage.back();
+            at->free_storage.pop_back();
+        }
+
+        try {
+            Agent * agent_ptr = at->construct_agent(memory, instance, *this);
+            agent_ptr->_pooled = true;
+            return agent_ptr;
+        } catch ( ... ) {
+            at->free_storage.push_back(memory);
+            throw;
+        }
+
+    }
+
+    // Destroys an agent. When recycle is true its body and shape, which
+    // must already be out of the space, and its storage go back to its
+    // type's pools.
+    void World::destroy_agent(Agent * agent_ptr, bool recycle) {
+
+        AGENT_TYPE * at = agent_ptr->_type;
+
+        if ( recycle && at ) {
+            at->free_bodies.push_back({ agent_ptr->_body, agent_ptr->_shape });
+            agent_ptr->_body = NULL;
+            agent_ptr->_shape = NULL;
+        }
+
+        if ( agent_ptr->_pooled ) {
+            at->destruct_agent(agent_ptr);
+            if ( recycle ) {
+                at->free_storage.push_back(agent_ptr);
+            } else {
+                ::operator delete(agent_ptr);
+            }
+        } else if ( agent_ptr->_destroyer ) {
+            agent_ptr->_destroyer(agent_ptr);
+        } else {
+            delete agent_ptr;
+        }
+
+    }
+
     World::~World() {
         cpSpaceFree(space);
         for ( auto agent_ptr : agents ) {
-            agent_ptr->_destroyer(agent_ptr);
+            destroy_agent(agent_ptr, false);
+        }
+        for ( auto agent_ptr : new_agents ) {
+            destroy_agent(agent_ptr, false);
+        }
+        for ( auto agent_ptr : garbage ) {
+            destroy_agent(agent_ptr, true);
+        }
+        for ( auto agent_ptr : statics ) {
+            delete agent_ptr;
+        }
+        for ( auto& entry : agent_types ) {
+            for ( auto memory : entry.second->free_storage ) {
+                ::operator delete(memory);
+            }
+            for ( auto& pair : entry.second->free_bodies ) {
+                cpShapeFree(pair.second);
+                cpBodyFree(pair.first);
+            }
         }
     }
 
@@ -112,38 +288,214 @@ namespace enviro {
     }
 
     void World::init() {
-        collsion_handler = cpSpaceAddCollisionHandler(space, AGENT_COLLISION_TYPE, AGENT_COLLISION_TYPE);
-        collsion_handler->beginFunc = handle_collision;
+        install_collision_handlers();
+        for ( auto agent_ptr : agents ) {
+            agent_ptr->set_manager(manager_ptr);
+            agent_ptr->init();
+        }
+        publish_snapshot();
+    }
+
+    void World::start() {
+        last_step_time = milli_time();
+        next_controller_time = milli_time();
+        for ( auto agent_ptr : agents ) {
+            agent_ptr->start();
+        }
+    }
+
+    void World::stop() {
+        for ( auto agent_ptr : agents ) {
+            agent_ptr->stop();
+        }
+    }
+
+    // Runs every agent's update, at most once per AGENT_PERIOD. Agents are
+    // not scheduled with the manager, so that the world can add and remove
+    // them in bulk. With a worker pool, controllers only read the space
+    // while they run: their actuator commands and spawned agents are
+    // buffered and then applied here, commands in agent order, so the
+    // outcome does not depend on how the work was split up. Only the ids
+    // of agents spawned in the same phase depend on which thread got to
+    // the slot table first.
+    void World::update_controllers() {
+
+        double now = milli_time();
+        if ( now < next_controller_time ) {
+            return;
+        }
+        next_controller_time = std::max(
+            next_controller_time + duration<double, std::milli>(AGENT_PERIOD).count(),
+            now
+        );
+
+        if ( !workers ) {
+            // Agents added by controllers go to new_agents, so this is safe
+            for ( auto agent_ptr : agents ) {
+                agent_ptr->update();
+            }
+            return;
+        }
+
+        for ( auto agent_ptr : agents ) {
+            agent_ptr->_deferred = true;
+        }
+
+        parallel_phase = true;
+        workers->parallel_for(agents.size(), [this](int i) {
+            agents[i]->update();
+        });
+        parallel_phase = false;
+
+        for ( auto agent_ptr : agents ) {
+            agent_ptr->apply_commands();
+        }
+
+        // Then agents spawned during the phase join the space, in the order
+        // they were made, and start
+        for ( auto agent_ptr : spawned ) {
+            agent_ptr->enter_space();
+            agent_ptr->apply_commands();
+            agent_ptr->set_manager(manager_ptr);
+            agent_ptr->init();
+            agent_ptr->start();
+            new_agents.push_back(agent_ptr);
+        }
+        spawned.clear();
+
+    }
+
+    void World::install_collision_handlers() {
+        for ( auto pair : new_collision_pairs ) {
+            cpCollisionHandler * handler = cpSpaceAddCollisionHandler(
+                space, 
+                collision_type(pair.first), 
+                collision_type(pair.second));
+            handler->beginFunc = handle_collision;
+        }
+        new_collision_pairs.clear();
     }
 
     void World::update() {
-        // std::cout << "A\n";
+
+        PhaseTimer timer;
+
         for ( auto c : new_constraints ) {
-             cpSpaceAddConstraint(space, std::get<2>(c));
-             constraints.push_back(c);
+             cpSpaceAddConstraint(space, c);
         }
-        // std::cout << "B\n";
         new_constraints.erase(new_constraints.begin(), new_constraints.end());
-        // std::cout << "C\n";
+        timer.mark(PHASE_CONSTRAINTS);
+
         for ( auto agent_ptr : garbage ) {
-            delete agent_ptr;
+            destroy_agent(agent_ptr, true);
         }
         garbage.erase(garbage.begin(), garbage.end());
-        process_removals(); // removes agents from manager, but manager is still going through agents
-        // std::cout << "D\n";
+        timer.mark(PHASE_GARBAGE);
+
+        process_removals();
+        timer.mark(PHASE_REMOVALS);
+
         for ( auto agent_ptr : new_agents ) {
             add_agent(*agent_ptr);
-            manager_ptr->add(*agent_ptr, 100_ms);
         }
-        // std::cout << "E\n";
         new_agents.erase(new_agents.begin(), new_agents.end());
-        // std::cout << "F\n";
-        cpSpaceStep(space, timeStep);
-        // std::cout << "G\n";
+        timer.mark(PHASE_NEW_AGENTS);
+
+        update_controllers();
+        timer.mark(PHASE_CONTROLLERS);
+
+        install_collision_handlers();
+        step();
+        timer.mark(PHASE_STEP);
+
+        long long now = steady_ms();
+        bool demanded = now - snapshot_demand.load() < SNAPSHOT_DEMAND_WINDOW;
+        if ( now - last_snapshot_time >= ( demanded ? snapshot_period : std::max(snapshot_period, SNAPSHOT_IDLE_PERIOD) ) ) {
+            publish_snapshot();
+        }
+        timer.mark(PHASE_SNAPSHOT);
+
+        timer.finish();
+        profiler.commit(timer, agents.size(), shape_count, step_count);
+
+    }
+
+    // Takes as many fixed physics steps as the time since the last update
+    // calls for, so the simulation keeps pace with the clock however often
+    // the manager runs the world. If an update overran and more than
+    // max_catch_up_steps are owed, the rest are dropped and the simulation
+    // falls behind rather than spiralling.
+    void World::step() {
+
+        double now = milli_time();
+        accumulator += now - last_step_time;
+        last_step_time = now;
+
+        double period = get_step_period_ms();
+        int n = 0;
+        while ( accumulator >= period - STEP_PERIOD_SLACK && n < max_catch_up_steps ) {
+            for ( int i=0; i<substeps; i++ ) {
+                cpSpaceStep(space, time_step / substeps);
+            }
+            step_count++;
+            accumulator -= period;
+            n++;
+        }
+
+        if ( n > 0 ) {
+            raycaster.stepped();
+        }
+
+        if ( accumulator >= period ) {
+            accumulator = fmod(accumulator, period);
+        }
+        interpolation = std::max(0.0, accumulator / period);
+
+    }
+
+    std::shared_ptr<const WORLD_FRAME> World::snapshot() {
+        snapshot_demand.store(steady_ms());
+        return std::atomic_load(&latest_snapshot);
+    }
+
+    void World::publish_snapshot() {
+        std::atomic_store(&latest_snapshot, capture());
+        last_snapshot_time = steady_ms();
+    }
+
+    std::shared_ptr<const WORLD_FRAME> World::capture() {
+
+        auto frame = std::make_shared<WORLD_FRAME>();
+
+        if ( ++snapshot_number == 0 ) {
+            snapshot_number = 1;
+        }
+        frame->number = snapshot_number;
+        frame->center_x = center_x;
+        frame->center_y = center_y;
+        frame->zoom = zoom;
+        frame->interpolation = interpolation;
+        frame->timestamp = std::time(0);
+
+        for ( auto agent_ptr : agents ) {
+            if ( agent_ptr->visible() ) {
+                frame->agents.push_back(agent_ptr->record());
+            }
+        }
+
+        std::sort(frame->agents.begin(), frame->agents.end(), [](const AGENT_RECORD& a, const AGENT_RECORD& b) {
+            return a.id < b.id;
+        });
+
+        return frame;
+
     }
 
     World& World::add_agent(Agent& agent) {
         agents.push_back(&agent); 
+        if ( agent._shape ) {
+            shape_count++;
+        }
         return *this;
     }
 
@@ -161,80 +513,175 @@ namespace enviro {
     }
 
     Agent& World::find_agent(int id) {
-        for(auto agent_ptr : agents) {
-            if ( agent_ptr->get_id() == id ) {
-                return *agent_ptr;
+        Agent * agent_ptr = lookup(id);
+        if ( agent_ptr == NULL ) {
+            std::string msg = "Could not find agent with id ";
+            msg += std::to_string(id);
+            throw std::runtime_error(msg);
+        }
+        return *agent_ptr;
+    }
+
+    int World::register_agent(Agent * agent) {
+        int slot;
+        if ( free_slots.empty() ) {
+            slot = slots.size();
+            if ( slot > AGENT_SLOT_MASK ) {
+                throw std::runtime_error("Too many agents: agent slot table is full");
             }
+            slots.push_back({ agent, 0 });
+        } else {
+            slot = free_slots.front();
+            free_slots.pop_front();
+            slots[slot].agent = agent;
         }
-        std::string msg = "Could not find agent with id ";
-        msg += id;
-        throw std::runtime_error(msg);
+        return ( slots[slot].generation << AGENT_SLOT_BITS ) | slot;
+    }
+
+    void World::release_agent_id(int id) {
+        if ( slot_agent(id) != NULL ) {
+            AGENT_SLOT& s = slots[id & AGENT_SLOT_MASK];
+            s.agent = NULL;
+            // A slot whose generation is used up is retired rather than
+            // wrapped, so that no id it has handed out can match it again
+            if ( s.generation < AGENT_MAX_GENERATION ) {
+                s.generation++;
+                free_slots.push_back(id & AGENT_SLOT_MASK);
+            }
+        }
+    }
+
+    int World::intern_type(const std::string& name) {
+        auto i = type_ids.find(name);
+        if ( i != type_ids.end() ) {
+            return i->second;
+        }
+        int id = type_names.size();
+        type_names.push_back(name);
+        type_ids[name] = id;
+        return id;
+    }
+
+    int World::type_id(const std::string& name) {
+        std::shared_lock<std::shared_mutex> lock(space_mutex, std::defer_lock);
+        if ( parallel_phase ) {
+            lock.lock();
+        }
+        auto i = type_ids.find(name);
+        return i == type_ids.end() ? -1 : i->second;
+    }
+
+    cpCollisionType World::collision_type(int type_id) {
+        return AGENT_COLLISION_TYPE + type_id;
+    }
+
+    int World::watch_collisions(int type, const std::string& other_type) {
+        std::unique_lock<std::shared_mutex> lock(space_mutex, std::defer_lock);
+        if ( parallel_phase ) {
+            lock.lock();
+        }
+        int other = intern_type(other_type);
+        auto pair = std::minmax(type, other);
+        if ( collision_pairs.insert(pair).second ) {
+            new_collision_pairs.push_back(pair);
+        }
+        return other;
     }
 
     void World::add_constraint(Agent& a, Agent& b) {
-        if ( ! attached(a,b) ) {
+        std::unique_lock<std::shared_mutex> lock(space_mutex, std::defer_lock);
+        if ( parallel_phase ) {
+            lock.lock();
+        }
+        if ( &a != &b && ! is_attached(a.get_id(), b.get_id()) ) {
             cpConstraint * c = cpPinJointNew(a._body, b._body, cpvzero, cpvzero);
-            new_constraints.push_back(std::make_tuple(a.get_id(),b.get_id(),c));
+            adjacency[a.get_id()][b.get_id()] = c;
+            adjacency[b.get_id()][a.get_id()] = c;
+            new_constraints.push_back(c);
         }
     }
 
     bool World::attached(Agent& a, Agent& b) {
-        for ( auto c : constraints ) {
-            if ( std::get<0>(c) == a.get_id() && std::get<1>(c) == b.get_id() ) {
-                return true;
-            }
+        std::shared_lock<std::shared_mutex> lock(space_mutex, std::defer_lock);
+        if ( parallel_phase ) {
+            lock.lock();
         }
-        return false;
+        return is_attached(a.get_id(), b.get_id());
+    }
+
+    bool World::is_attached(int a, int b) const {
+        auto i = adjacency.find(a);
+        return i != adjacency.end() && i->second.find(b) != i->second.end();
     }
 
     bool World::exists(int id) {
-        for ( Agent * a : agents ) {
-            if ( a->get_id() == id ) {
-                return true;
-            }
-        }
-        return false;
+        return lookup(id) != NULL;
     }
 
     void World::remove(int id) {
-        if ( exists(id) ) {
-            find_agent(id).mark_for_removal();
+        Agent * agent_ptr = lookup(id);
+        if ( agent_ptr != NULL ) {
+            agent_ptr->mark_for_removal();
         }
     }
 
     void World::remove_constraints_involving(int id) {
-       auto j = std::remove_if(constraints.begin(), constraints.end(), [&](Constraint c) {
-            bool found = (std::get<0>(c) == id || std::get<1>(c) == id);
-            if ( found ) {
-                auto constraint_ptr = std::get<2>(c);
+
+        auto i = adjacency.find(id);
+        if ( i == adjacency.end() ) {
+            return;
+        }
+
+        for ( auto& entry : i->second ) {
+
+            auto j = adjacency.find(entry.first);
+            j->second.erase(id);
+            if ( j->second.empty() ) {
+                adjacency.erase(j);
+            }
+
+            cpConstraint * constraint_ptr = entry.second;
+            if ( cpSpaceContainsConstraint(space, constraint_ptr) ) {
                 cpSpaceRemoveConstraint(space, constraint_ptr);
-                cpConstraintDestroy(constraint_ptr);
-                cpConstraintFree(constraint_ptr);
+            } else {
+                // made since the last update and not in the space yet
+                new_constraints.erase(std::find(new_constraints.begin(), new_constraints.end(), constraint_ptr));
             }
-            return found;
-        }); 
-        constraints.erase(j,constraints.end()); 
+            cpConstraintDestroy(constraint_ptr);
+            cpConstraintFree(constraint_ptr);
+
+        }
+
+        adjacency.erase(i);
+
     }
 
+    // Takes every agent marked for removal out of the world in one pass
+    // that also compacts the agent list, keeping its order. Agents are not
+    // scheduled with the manager, so nothing else has to be searched. They
+    // are destroyed on the next update, once nothing is using them, and
+    // their bodies, shapes and storage are recycled.
     void World::process_removals() {
 
-        // remove from agents list
-        auto i = std::remove_if(agents.begin(), agents.end(), [&](Agent *a) {
-            if ( !a->is_alive() ) {
-                // remove all constraints involving the agent,
-                // remove its body and shape from the physics engine,
-                // remove it from the manager, and then destroy it
-                remove_constraints_involving(a->get_id());
+        auto kept = agents.begin();
+
+        for ( auto a : agents ) {
+            if ( a->is_alive() ) {
+                *kept++ = a;
+                continue;
+            }
+            remove_constraints_involving(a->get_id());
+            if ( a->_shape ) {
                 cpSpaceRemoveShape(space, a->_shape);
-                cpSpaceRemoveBody(space, a->_body);
-                manager_ptr->remove(*a);
-                garbage.push_back(a);
+                raycaster.shapes_changed();
+                shape_count--;
             }
-            return !a->is_alive();
-        });
-        
-        // delete the agent pointers 
-        agents.erase(i, agents.end());           
+            cpSpaceRemoveBody(space, a->_body);
+            release_agent_id(a->get_id());
+            garbage.push_back(a);
+        }
+
+        agents.erase(kept, agents.end());
 
     }
 
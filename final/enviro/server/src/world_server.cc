@@ -1,3 +1,5 @@
+#include <math.h>
+#include <string.h>
 #include "enviro.h"
 #include "world_server.h"
 
@@ -9,37 +11,101 @@ namespace enviro {
         return now;
     }    
 
-    WorldServer::WorldServer(World& world, std::mutex& mutex, json config) 
+    WorldServer::WorldServer(FrameSource& world, std::mutex& mutex, json config) 
         : world(world), 
         manager_mutex(mutex),
         ip(config["ip"].get<std::string>().c_str()),
-        port(config["port"]) {}
+        port(config["port"]),
+        stream_period(config.value("stream_period", 25)),
+        keyframe_interval(config.value("keyframe_interval", 40)),
+        viewport_margin(config.value("viewport_margin", 100.0)),
+        state_gzip(config.value("state_gzip", false)) {
+        add_world(world, mutex);
+    }
+
+    void WorldServer::add_world(FrameSource& world, std::mutex& mutex) {
+        worlds.push_back({ 
+            &world, 
+            &mutex, 
+            std::make_shared<ResponseCache>(), 
+            std::make_shared<StateEncoder>(),
+            std::make_shared<StateStream>(),
+            {}
+        });
+    }
 
     void WorldServer::run() {
 
         uWS::SSLApp app = uWS::SSLApp()    // TODO: cast insteead of wrap where
           .get("/config/:id", [&](auto *res, auto *req) { get_config(res,req); })
           .get("/state/:id",  [&](auto *res, auto *req) { get_state(res,req); })
+          .get("/metrics",    [&](auto *res, auto *req) { get_metrics(res,req); })
           .post("/event",     [&](auto *res, auto *req) { process_client_event(res,req); })
-          .listen(port,       [&](auto *token)          { listen(token);      })
-          .run();
+          .get("/w/:world/config/:id", [&](auto *res, auto *req) { get_world_config(res,req); })
+          .get("/w/:world/state",      [&](auto *res, auto *req) { get_world_state(res,req); })
+          .get("/w/:world/state/:id",  [&](auto *res, auto *req) { get_world_state(res,req); })
+          .get("/w/:world/metrics",    [&](auto *res, auto *req) { get_world_metrics(res,req); })
+          .post("/w/:world/event",     [&](auto *res, auto *req) { process_world_event(res,req); });
+
+        // Each world has its own /stream. The worlds are all known by now,
+        // so their addresses in the vector are fixed.
+        for ( int k=0; k<worlds.size(); k++ ) {
+            SERVED_WORLD * w = &worlds[k];
+            std::vector<std::string> routes = { "/w/" + std::to_string(k) + "/stream" };
+            if ( k == 0 ) {
+                routes.push_back("/stream");
+            }
+            for ( auto& route : routes ) {
+                app.ws<STREAM_CLIENT>(route, {
+                    .maxPayloadLength = 1024,
+                    .idleTimeout = 60,
+                    .open =    [this,w](auto *ws)                                 { open_stream(ws, w); },
+                    .message = [this](auto *ws, std::string_view msg, uWS::OpCode) { receive_ack(ws, msg); },
+                    .close =   [this,w](auto *ws, int code, std::string_view msg)  { close_stream(ws, w); }
+                });
+            }
+        }
+
+        app.listen(port, [&](auto *token) { listen(token); });
+
+        // Frames are pushed from a timer on the server's own event loop, 
+        // since sockets may only be written from the thread running it.
+        struct us_loop_t * loop = (struct us_loop_t *) uWS::Loop::get();
+        struct us_timer_t * timer = us_create_timer(loop, 0, sizeof(WorldServer *));
+        *(WorldServer **) us_timer_ext(timer) = this;
+        us_timer_set(timer, [](struct us_timer_t * t) {
+            (*(WorldServer **) us_timer_ext(t))->push_state();
+        }, stream_period, stream_period);
+
+        app.run();
 
         throw std::runtime_error("Server run returned, which it shouldn't do.");
 
     }
 
     void WorldServer::get_config(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        send_config(res, req->getParameter(0), worlds[0]);
+    }
+
+    void WorldServer::get_world_config(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        SERVED_WORLD * w = find_world(res, req);
+        if ( w ) {
+            send_config(res, req->getParameter(1), *w);
+        }
+    }
+
+    void WorldServer::send_config(uWS::HttpResponse<true> *res, std::string_view client_id, SERVED_WORLD& w) {
         
         json result = {
             { "result", "ok" },
             { "timestamp", unix_timestamp() },
-            { "config", world.get_config() }
+            { "config", w.source->get_config() }
         };
 
-        json event_data = { {"client_id", req->getParameter(0) }};
-        manager_mutex.lock(); ///////////////////////////////////////////////        
-        world.emit(Event("connection", event_data));                       //
-        manager_mutex.unlock(); /////////////////////////////////////////////  
+        json event_data = { {"client_id", client_id }};
+        w.mutex->lock(); ////////////////////////////////////////////////////
+        w.source->handle_event(Event("connection", event_data));          //
+        w.mutex->unlock(); //////////////////////////////////////////////////
 
         res->writeHeader("Access-Control-Allow-Origin", "*");
         res->end(result.dump().c_str());
@@ -48,42 +114,134 @@ namespace enviro {
 
     void WorldServer::get_state(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
 
-        json agent_list;
-        double cx, cy, z;
-        
-        manager_mutex.lock(); ///////////////////////////////////////////////        
-        world.all([&](Agent& agent) {                                      //
-            if ( agent.visible() ) {                                       //
-                agent_list.push_back(agent.serialize());                   //
-            }                                                              //
-            cx = world.get_center_x();                                     //
-            cy = world.get_center_y();                                     //
-            z = world.get_zoom();                                          //
-        });                                                                //
-        manager_mutex.unlock(); /////////////////////////////////////////////
+        // Reads the world's published snapshot, so the simulation thread is
+        // never blocked while the response is being built.
+        send_state(res, req, worlds[0]);
+
+    } 
+
+    // Clients that report their viewport only get the agents in it. With
+    // format=binary, the frame is sent in StateEncoder's layout, with the
+    // table entries past the client's known ones (table and known) and
+    // quantized poses if quantize=1. Responses come from the world's
+    // cache, so clients polling the same frame with the same parameters
+    // share one serialization.
+    void WorldServer::send_state(uWS::HttpResponse<true> *res, uWS::HttpRequest *req, SERVED_WORLD& w) {
+
+        auto frame = w.source->snapshot();
+
+        std::string_view query = req->getQuery();
+        BOUNDS viewport;
+        bool culled = parse_viewport(query, viewport_margin, viewport);
+
+        // Viewports are widened to multiples of the margin, so that clients
+        // looking at nearly the same place ask for the same response
+        if ( culled && viewport_margin > 0 ) {
+            viewport.left = viewport_margin * floor(viewport.left / viewport_margin);
+            viewport.bottom = viewport_margin * floor(viewport.bottom / viewport_margin);
+            viewport.right = viewport_margin * ceil(viewport.right / viewport_margin);
+            viewport.top = viewport_margin * ceil(viewport.top / viewport_margin);
+        }
+
+        std::string format, table, known, quantize;
+        query_parameter(query, "format", format);
+        bool binary = format == "binary";
+        uint32_t table_id = 0, num_known = 0;
+        if ( binary ) {
+            query_parameter(query, "table", table);
+            query_parameter(query, "known", known);
+            query_parameter(query, "quantize", quantize);
+            table_id = strtoul(table.c_str(), NULL, 10);
+            num_known = strtoul(known.c_str(), NULL, 10);
+        }
+
+        char key[128];
+        if ( binary ) {
+            snprintf(key, sizeof(key), "binary %u %u %d", table_id, num_known, quantize == "1");
+        } else {
+            snprintf(key, sizeof(key), "json");
+        }
+        if ( culled ) {
+            snprintf(key + strlen(key), sizeof(key) - strlen(key), " %g %g %g %g",
+                     viewport.left, viewport.bottom, viewport.right, viewport.top);
+        }
+
+        bool gzip = state_gzip && req->getHeader("accept-encoding").find("gzip") != std::string_view::npos;
+
+        auto response = w.cache->get(frame->number, key, gzip, [&]() {
+            if ( binary ) {
+                return w.encoder->encode(*frame, table_id, num_known, quantize == "1", culled ? &viewport : NULL);
+            } else {
+                return frame_to_json(*frame, culled ? &viewport : NULL);
+            }
+        });
 
-        json result = {
-            { "result", "ok" },
-            { "timestamp", unix_timestamp() },
-            { "agents", agent_list },
-            { "center", { { "x", cx }, { "y", cy } } },
-            { "zoom", z }
-        };
-        
         res->writeHeader("Access-Control-Allow-Origin", "*");
-        res->end(result.dump().c_str());
+        if ( binary ) {
+            res->writeHeader("Content-Type", "application/octet-stream");
+        }
+        if ( gzip ) {
+            res->writeHeader("Content-Encoding", "gzip");
+        }
+        res->end(*response);
 
-    } 
+    }
+
+    void WorldServer::get_metrics(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        res->writeHeader("Content-Type", "text/plain; version=0.0.4");
+        res->end(world.metrics() + worlds[0].cache->metrics());
+    }
 
     void WorldServer::process_client_event(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        receive_event(res, &worlds[0]);
+    }
+
+    // Returns the world named by the :world parameter, or responds with a 
+    // 404 and returns NULL if there is none.
+    SERVED_WORLD * WorldServer::find_world(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        std::string name(req->getParameter(0));
+        char * end;
+        long k = strtol(name.c_str(), &end, 10);
+        if ( name.empty() || *end != '\0' || k < 0 || k >= worlds.size() ) {
+            res->writeStatus("404 Not Found");
+            res->writeHeader("Access-Control-Allow-Origin", "*");
+            res->end(json({ { "result", "error" }, { "error", "no world " + name } }).dump());
+            return NULL;
+        }
+        return &worlds[k];
+    }
+
+    void WorldServer::get_world_state(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        SERVED_WORLD * w = find_world(res, req);
+        if ( w ) {
+            send_state(res, req, *w);
+        }
+    }
+
+    void WorldServer::get_world_metrics(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        SERVED_WORLD * w = find_world(res, req);
+        if ( w ) {
+            res->writeHeader("Content-Type", "text/plain; version=0.0.4");
+            res->end(w->source->metrics() + w->cache->metrics());
+        }
+    }
+
+    void WorldServer::process_world_event(uWS::HttpResponse<true> *res, uWS::HttpRequest *req) {
+        SERVED_WORLD * w = find_world(res, req);
+        if ( w ) {
+            receive_event(res, w);
+        }
+    }
+
+    void WorldServer::receive_event(uWS::HttpResponse<true> *res, SERVED_WORLD * w) {
         std::string buffer;
-        res->onData([this,res,buffer=std::move(buffer)](std::string_view data, bool last) mutable {
+        res->onData([res,w,buffer=std::move(buffer)](std::string_view data, bool last) mutable {
             buffer.append(data.data(), data.length());
             if ( last ) {
                 json data = json::parse(buffer);
-                manager_mutex.lock(); ///////////////////////////////////////////////        
-                world.emit(Event(data["type"], data));                             //
-                manager_mutex.unlock(); /////////////////////////////////////////////            
+                w->mutex->lock(); ///////////////////////////////////////////////////
+                w->source->handle_event(Event(data["type"], data));                //
+                w->mutex->unlock(); /////////////////////////////////////////////////
             }
         });
         json result = {
@@ -94,6 +252,61 @@ namespace enviro {
         res->end(result.dump().c_str());            
     }
 
+    void WorldServer::open_stream(StreamSocket * ws, SERVED_WORLD * w) {
+        *ws->getUserData() = { 0, 0 };
+        w->stream_clients.insert(ws);
+    }
+
+    void WorldServer::close_stream(StreamSocket * ws, SERVED_WORLD * w) {
+        w->stream_clients.erase(ws);
+    }
+
+    // Clients acknowledge each frame they decode with its number as a
+    // little-endian u32. An acknowledgement of zero asks for a keyframe.
+    void WorldServer::receive_ack(StreamSocket * ws, std::string_view message) {
+        if ( message.size() == 4 ) {
+            const unsigned char * b = (const unsigned char *) message.data();
+            uint32_t frame = b[0] | ( b[1] << 8 ) | ( b[2] << 16 ) | ( (uint32_t) b[3] << 24 );
+            STREAM_CLIENT * client = ws->getUserData();
+            if ( frame == 0 || frame > client->acked ) {
+                client->acked = frame;
+            }
+        }
+    }
+
+    void WorldServer::push_state() {
+        for ( auto& w : worlds ) {
+            push_state(w);
+        }
+    }
+
+    void WorldServer::push_state(SERVED_WORLD& w) {
+
+        if ( w.stream_clients.empty() ) {
+            return;
+        }
+
+        if ( !w.stream->publish(w.source->snapshot()) ) {
+            return; // nothing new since the last push
+        }
+
+        for ( auto ws : w.stream_clients ) {
+            STREAM_CLIENT * client = ws->getUserData();
+            if ( ws->getBufferedAmount() > 0 ) {
+                continue; // the client is behind, so let it drain first
+            }
+            uint32_t baseline = client->since_keyframe >= keyframe_interval ? 0 : client->acked;
+            const std::string& message = w.stream->encode(baseline);
+            if ( message[1] & STREAM_KEYFRAME ) {
+                client->since_keyframe = 0;
+            } else {
+                client->since_keyframe++;
+            }
+            ws->send(message, uWS::OpCode::BINARY);
+        }
+
+    }
+
     void WorldServer::listen(us_listen_socket_t * token) {
         if (token) {
             std::cout << "Listening on port " << port << std::endl;
@@ -0,0 +1,44 @@
+# Static agent build, included at the end of a project's src/Makefile.
+#
+#   make static
+#
+# compiles the project's agents straight into a copy of the enviro 
+# executable, ../bin/enviro, which registers them through AgentRegistry 
+# instead of loading lib/*.so at run time. Run it from the project 
+# directory in place of enviro. Types it does not contain are still 
+# loaded with dlopen.
+#
+# Only one project's agents go in each executable, since different 
+# projects reuse class names such as Block and Guy.
+
+#Directories
+ENVIROBUILD  := $(ENVIRODIR)/../build
+ELMADIR      := /development/elma
+STATICDIR    := ../build
+STATICTARGET := ../bin/enviro
+
+#Flags, Libraries and Includes
+STATICFLAGS  := -O3 -DENVIRO_STATIC_AGENTS
+STATICLIB    := -lpthread -lelma -lchipmunk -ldl -luSockets -lz
+STATICLIBDIR := -L $(CHIPDIR)/build/src -L $(ELMADIR)/lib -L /usr/local/lib/uSockets
+
+#Files
+STATICOBJECTS := $(addprefix $(STATICDIR)/, $(patsubst %.cc,%.o,$(SOURCES)))
+
+static: $(STATICTARGET)
+
+#Link, with the server's own objects
+$(STATICTARGET): $(STATICOBJECTS) $(wildcard $(ENVIROBUILD)/*.o)
+	@test -n "$(wildcard $(ENVIROBUILD)/*.o)" || ( echo "Build the enviro server in $(ENVIROBUILD)/.. first"; exit 1 )
+	@mkdir -p $(dir $@)
+	$(CC) $(STATICFLAGS) -o $@ $(STATICOBJECTS) $(wildcard $(ENVIROBUILD)/*.o) $(STATICLIBDIR) $(STATICLIB)
+
+#Compile, naming each agent after the library it would otherwise be in
+$(STATICDIR)/%.o: %.cc %.h
+	@mkdir -p $(STATICDIR)
+	$(CC) $(STATICFLAGS) -DENVIRO_CONTROLLER='"lib/$*.so"' $(INCLUDE) -c $< -o $@
+
+static-clean:
+	@$(RM) -rf $(STATICDIR)/*.o $(STATICTARGET)
+
+.PHONY: static static-clean
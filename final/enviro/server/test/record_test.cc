@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "gtest/gtest.h"
+#include "recorder.h"
+#include "replay.h"
+
+// Round trips through the record log: frames written with RecordWriter
+// are played back by Replay, paused at a chosen position.
+
+using namespace enviro;
+
+namespace {
+
+    std::string temporary_file() {
+        char name[] = "/tmp/enviro_record_test_XXXXXX";
+        int fd = mkstemp(name);
+        close(fd);
+        return name;
+    }
+
+    AGENT_RECORD agent(int id, double x, std::shared_ptr<const std::string> spec, std::string label) {
+        AGENT_RECORD a = {};
+        a.id = id;
+        a.x = x;
+        a.y = -x;
+        a.theta = 0.5;
+        a.vx = 1;
+        a.vy = 2;
+        a.omega = -0.25;
+        a.sensors = { 3.5, 100 };
+        a.specification = spec;
+        a.decoration = "<rect/>";
+        a.label = label;
+        a.label_x = 5;
+        a.label_y = -5;
+        return a;
+    }
+
+    WORLD_FRAME frame(long int timestamp, std::vector<AGENT_RECORD> agents) {
+        WORLD_FRAME f = {};
+        f.timestamp = timestamp;
+        f.center_x = 10;
+        f.center_y = 20;
+        f.zoom = 0.75;
+        f.agents = agents;
+        return f;
+    }
+
+    void expect_same(const WORLD_FRAME& f, const WORLD_FRAME& g) {
+        EXPECT_EQ(f.timestamp, g.timestamp);
+        EXPECT_EQ((float) f.center_x, g.center_x);
+        EXPECT_EQ((float) f.center_y, g.center_y);
+        EXPECT_EQ((float) f.zoom, g.zoom);
+        ASSERT_EQ(f.agents.size(), g.agents.size());
+        for ( size_t i=0; i<f.agents.size(); i++ ) {
+            const AGENT_RECORD& a = f.agents[i];
+            const AGENT_RECORD& b = g.agents[i];
+            EXPECT_EQ(a.id, b.id);
+            EXPECT_EQ(*a.specification, *b.specification);
+            EXPECT_EQ((float) a.x, b.x);
+            EXPECT_EQ((float) a.y, b.y);
+            EXPECT_EQ((float) a.theta, b.theta);
+            EXPECT_EQ((float) a.vx, b.vx);
+            EXPECT_EQ((float) a.vy, b.vy);
+            EXPECT_EQ((float) a.omega, b.omega);
+            EXPECT_EQ(a.decoration, b.decoration);
+            EXPECT_EQ(a.label, b.label);
+            EXPECT_EQ((float) a.label_x, b.label_x);
+            EXPECT_EQ((float) a.label_y, b.label_y);
+            ASSERT_EQ(a.sensors.size(), b.sensors.size());
+            for ( size_t j=0; j<a.sensors.size(); j++ ) {
+                EXPECT_EQ((float) a.sensors[j], b.sensors[j]);
+            }
+        }
+    }
+
+    class RecordTest : public ::testing::Test {
+
+        protected:
+
+        void SetUp() {
+            filename = temporary_file();
+            auto robot = std::make_shared<const std::string>(
+                "{\"definition\":{\"name\":\"robot\",\"type\":\"dynamic\"},\"style\":{\"fill\":\"red\"}}");
+            auto block = std::make_shared<const std::string>(
+                "{\"definition\":{\"name\":\"block\",\"type\":\"dynamic\"}}");
+            frames = {
+                frame(1000, { agent(1, 0, robot, "a"), agent(2, 1, block, "") }),
+                frame(1001, { agent(1, 0.5, robot, "a"), agent(2, 1.5, block, "b"), agent(7, 9, robot, "a") }),
+                frame(1002, { agent(2, 2, block, "b") })
+            };
+            times = { 5000, 5100, 5250 };
+            RecordWriter writer(filename);
+            for ( size_t i=0; i<frames.size(); i++ ) {
+                writer.write(frames[i], times[i]);
+            }
+        }
+
+        void TearDown() {
+            unlink(filename.c_str());
+        }
+
+        std::string filename;
+        std::vector<WORLD_FRAME> frames;
+        std::vector<double> times;
+
+    };
+
+}
+
+TEST_F(RecordTest, ReplaysEachFrame) {
+
+    // Paused at a position, playback shows the last frame recorded at or
+    // before it
+    std::vector<std::pair<double, int>> positions = { { 0, 0 }, { 0.05, 0 }, { 0.1, 1 }, { 0.2, 1 }, { 0.25, 2 }, { 9, 2 } };
+    for ( auto& p : positions ) {
+        Replay replay(filename, json::object(), 0, p.first);
+        EXPECT_DOUBLE_EQ(replay.length(), 0.25);
+        auto f = replay.snapshot();
+        ASSERT_TRUE(f);
+        expect_same(frames[p.second], *f);
+    }
+
+}
+
+TEST_F(RecordTest, SplitsSpecifications) {
+
+    Replay replay(filename, json::object(), 0, 0.1);
+    auto f = replay.snapshot();
+    ASSERT_EQ(f->agents.size(), 3u);
+    EXPECT_EQ(json::parse(*f->agents[0].definition)["name"], "robot");
+    EXPECT_EQ(json::parse(*f->agents[0].style)["fill"], "red");
+    EXPECT_EQ(json::parse(*f->agents[1].definition)["name"], "block");
+    EXPECT_EQ(*f->agents[1].style, "{}");
+    EXPECT_EQ(f->agents[0].definition, f->agents[2].definition);
+
+}
+
+TEST_F(RecordTest, IgnoresIncompleteLastEntry) {
+
+    FILE * f = fopen(filename.c_str(), "rb");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    ASSERT_EQ(truncate(filename.c_str(), size - 3), 0);
+
+    Replay replay(filename, json::object(), 0, 9);
+    EXPECT_DOUBLE_EQ(replay.length(), 0.1);
+    expect_same(frames[1], *replay.snapshot());
+
+}
+
+TEST_F(RecordTest, RejectsOtherFiles) {
+
+    FILE * f = fopen(filename.c_str(), "wb");
+    fputs("not a recording", f);
+    fclose(f);
+    EXPECT_THROW(Replay(filename, json::object()), std::runtime_error);
+
+}
@@ -0,0 +1,93 @@
+#include "gtest/gtest.h"
+#include "json_helper.h"
+#include "schema.h"
+
+// Checks of documents against compiled schemas: what is accepted, and the
+// JSON pointer and value named when something is not.
+
+using json_helper::Schema;
+
+namespace {
+
+    // The message the check gives, or "" if the document matches
+    std::string error(const json& schema, const json& object) {
+        try {
+            Schema(schema).check(object);
+        } catch ( const std::runtime_error& e ) {
+            return e.what();
+        }
+        return "";
+    }
+
+}
+
+TEST(Schema, SchemasMatchThemselves) {
+
+    // Schemas are example documents, so each is a valid instance of itself
+    for ( auto& s : { ENVIRO_CONFIG_SCHEMA, ENVIRO_AGENT_SCHEMA, ENVIRO_OMNI_AGENT_SCHEMA,
+                      ENVIRO_NONINTERACTIVE_SCHEMA, ENVIRO_INVISIBLE_SCHEMA } ) {
+        EXPECT_EQ(error(s, s), "");
+        EXPECT_NO_THROW(json_helper::check(s, s));
+    }
+
+}
+
+TEST(Schema, AcceptsExtraKeysAndAnyArrayLength) {
+
+    json schema = { { "name", "" }, { "points", { { { "x", 0 } } } } };
+    EXPECT_EQ(error(schema, { { "name", "a" }, { "points", json::array() } }), "");
+    EXPECT_EQ(error(schema, { { "name", "a" }, { "extra", true }, { "points", { { { "x", 1 }, { "y", 2 } }, { { "x", 1.5 } } } } }), "");
+
+}
+
+TEST(Schema, NamesTheFirstMismatch) {
+
+    json schema = { { "agents", { { { "position", { { "x", 0 }, { "y", 0 } } } } } } };
+    json doc = { { "agents", json::array() } };
+    for ( int i=0; i<10; i++ ) {
+        doc["agents"].push_back({ { "position", { { "x", i }, { "y", i } } } });
+    }
+    EXPECT_EQ(error(schema, doc), "");
+
+    doc["agents"][7]["position"]["y"] = "oops";
+    doc["agents"][8]["position"]["x"] = nullptr;
+    EXPECT_EQ(error(schema, doc), "JSON Error: Expected number at /agents/7/position/y but got \"oops\"");
+
+    doc["agents"][7]["position"].erase("y");
+    EXPECT_EQ(error(schema, doc), "JSON Error: Expected key 'y' in object at /agents/7/position");
+
+    EXPECT_EQ(error(schema, json::array()), "JSON Error: Expected object at the root but got []");
+    EXPECT_EQ(error(schema, json::object()), "JSON Error: Expected key 'agents' in object at the root");
+    EXPECT_THROW(json_helper::check(doc, schema), std::runtime_error);
+
+}
+
+TEST(Schema, ChecksEachKind) {
+
+    EXPECT_EQ(error(nullptr, 1), "JSON Error: Expected null at the root but got 1");
+    EXPECT_EQ(error(true, "true"), "JSON Error: Expected Boolean at the root but got \"true\"");
+    EXPECT_EQ(error(0, false), "JSON Error: Expected number at the root but got false");
+    EXPECT_EQ(error("", 0), "JSON Error: Expected string at the root but got 0");
+    EXPECT_EQ(error({ 0 }, { 1, 2, "3" }), "JSON Error: Expected number at /2 but got \"3\"");
+    EXPECT_EQ(error({ 0 }, 1), "JSON Error: Expected array at the root but got 1");
+    EXPECT_EQ(error(json::object(), "anything"), "JSON Error: Expected object at the root but got \"anything\"");
+
+}
+
+TEST(Schema, EscapesPointersAndShortensValues) {
+
+    json schema = { { "a/b", { { "c~d", 0 } } } };
+    EXPECT_EQ(error(schema, { { "a/b", { { "c~d", "zero" } } } }),
+              "JSON Error: Expected number at /a~1b/c~0d but got \"zero\"");
+
+    std::string message = error({ { "s", 0 } }, { { "s", std::string(200, 'x') } });
+    EXPECT_EQ(message, "JSON Error: Expected number at /s but got \"" + std::string(76, 'x') + "...");
+
+}
+
+TEST(Schema, RejectsEmptySchemaArrays) {
+
+    EXPECT_THROW(Schema(json::array()), std::runtime_error);
+    EXPECT_THROW(Schema(json({ { "a", json::array() } })), std::runtime_error);
+
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <math.h>
+#include "gtest/gtest.h"
+#include "json/json.h"
+#include "state_encoder.h"
+
+// Round trips through /state?format=binary. Frames encoded by StateEncoder
+// are decoded by StateDecoder from client/src/enviro.js, run in node by
+// client/test/decode_state.js, and compared with what was encoded. The
+// tests are skipped if node is not installed.
+
+using namespace enviro;
+using nlohmann::json;
+
+namespace {
+
+    const char * DECODER = "../../client/test/decode_state.js";
+
+    bool have_node() {
+        return system("node --version > /dev/null 2>&1") == 0;
+    }
+
+    // Decodes the responses in order, as one client would, and returns the
+    // json array decode_state.js prints
+    json decode(const std::vector<std::string>& responses) {
+
+        std::vector<std::string> files;
+        std::string command = std::string("node ") + DECODER;
+        for ( auto& r : responses ) {
+            char name[] = "/tmp/enviro_state_test_XXXXXX";
+            int fd = mkstemp(name);
+            EXPECT_EQ(write(fd, r.data(), r.size()), (ssize_t) r.size());
+            close(fd);
+            files.push_back(name);
+            command += " ";
+            command += name;
+        }
+
+        std::string output;
+        FILE * p = popen(command.c_str(), "r");
+        char buffer[4096];
+        size_t n;
+        while ( ( n = fread(buffer, 1, sizeof(buffer), p) ) > 0 ) {
+            output.append(buffer, n);
+        }
+        EXPECT_EQ(pclose(p), 0) << command;
+        for ( auto& f : files ) {
+            unlink(f.c_str());
+        }
+        return json::parse(output);
+
+    }
+
+    AGENT_RECORD agent(int id, double x, double y,
+                       std::shared_ptr<const std::string> definition, std::shared_ptr<const std::string> style) {
+        AGENT_RECORD a = {};
+        a.id = id;
+        a.x = x;
+        a.y = y;
+        a.theta = 0.5 + id;
+        a.vx = 2 * id;
+        a.vy = -3;
+        a.omega = 0.25;
+        a.sensors = { 12.5, 100.0 * id };
+        a.definition = definition;
+        a.style = style;
+        return a;
+    }
+
+    WORLD_FRAME frame(uint32_t number, std::vector<AGENT_RECORD> agents) {
+        WORLD_FRAME f = {};
+        f.number = number;
+        f.center_x = 3;
+        f.center_y = -7;
+        f.zoom = 0.5;
+        f.interpolation = 0.25;
+        f.timestamp = 5000 + number;
+        f.agents = agents;
+        return f;
+    }
+
+    class StateEncoderTest : public ::testing::Test {
+
+        protected:
+
+        void SetUp() {
+            if ( !have_node() ) {
+                GTEST_SKIP() << "node is not installed";
+            }
+            robot = std::make_shared<const std::string>("{\"name\":\"robot\",\"shape\":\"omni\",\"radius\":10}");
+            block = std::make_shared<const std::string>("{\"name\":\"block\",\"shape\":[{\"x\":0,\"y\":0}]}");
+            red = std::make_shared<const std::string>("{\"fill\":\"red\"}");
+            blue = std::make_shared<const std::string>("{\"fill\":\"blue\",\"stroke\":\"black\"}");
+        }
+
+        // The decoded state must hold every agent of the frame, in order.
+        // Floats are exact to single precision, and quantized values within
+        // a little more than half a step, with the steps the encoder picks.
+        void expect_same(const WORLD_FRAME& f, const json& state, bool quantized) {
+
+            ASSERT_EQ(state["result"], "ok");
+            EXPECT_EQ(state["timestamp"], f.timestamp);
+            EXPECT_EQ(state["center"]["x"], (float) f.center_x);
+            EXPECT_EQ(state["center"]["y"], (float) f.center_y);
+            EXPECT_EQ(state["zoom"], (float) f.zoom);
+            EXPECT_EQ(state["interpolation"], (float) f.interpolation);
+            ASSERT_EQ(state["agents"].size(), f.agents.size());
+
+            double x0 = INFINITY, x1 = -INFINITY, y0 = INFINITY, y1 = -INFINITY, v = 0, w = 0, s = 0;
+            for ( auto& a : f.agents ) {
+                x0 = std::min(x0, a.x);
+                x1 = std::max(x1, a.x);
+                y0 = std::min(y0, a.y);
+                y1 = std::max(y1, a.y);
+                v = std::max({ v, fabs(a.vx), fabs(a.vy) });
+                w = std::max(w, fabs(a.omega));
+                for ( double r : a.sensors ) {
+                    s = std::max(s, fabs(r));
+                }
+            }
+            double dp = 0.6 * std::max(x1 - x0, y1 - y0) / 65535,
+                   dv = 0.6 * v / 32767,
+                   dw = 0.6 * w / 32767,
+                   ds = 0.6 * s / 65535,
+                   dt = 0.6 * 2 * M_PI / 65536;
+
+            auto near = [&](const json& decoded, double value, double tolerance) {
+                if ( quantized ) {
+                    EXPECT_NEAR(decoded.get<double>(), value, tolerance);
+                } else {
+                    EXPECT_EQ(decoded.get<double>(), (float) value);
+                }
+            };
+
+            for ( size_t i=0; i<f.agents.size(); i++ ) {
+                const AGENT_RECORD& a = f.agents[i];
+                const json& b = state["agents"][i];
+                EXPECT_EQ(b["id"], a.id);
+                EXPECT_EQ(b["specification"]["definition"], json::parse(*a.definition));
+                EXPECT_EQ(b["specification"]["style"], json::parse(*a.style));
+                near(b["position"]["x"], a.x, dp);
+                near(b["position"]["y"], a.y, dp);
+                if ( quantized ) {
+                    double turn = remainder(b["position"]["theta"].get<double>() - a.theta, 2 * M_PI);
+                    EXPECT_NEAR(turn, 0, dt) << "agent " << a.id;
+                } else {
+                    near(b["position"]["theta"], a.theta, dt);
+                }
+                near(b["velocity"]["x"], a.vx, dv);
+                near(b["velocity"]["y"], a.vy, dv);
+                near(b["velocity"]["theta"], a.omega, dw);
+                ASSERT_EQ(b["sensors"].size(), a.sensors.size());
+                for ( size_t j=0; j<a.sensors.size(); j++ ) {
+                    near(b["sensors"][j], a.sensors[j], ds);
+                }
+                EXPECT_EQ(b["decoration"], a.decoration);
+                EXPECT_EQ(b["label"]["text"], a.label);
+                EXPECT_EQ(b["label"]["x"], a.label_x);
+                EXPECT_EQ(b["label"]["y"], a.label_y);
+            }
+
+        }
+
+        std::shared_ptr<const std::string> robot, block, red, blue;
+
+    };
+
+}
+
+TEST_F(StateEncoderTest, FloatRoundTrip) {
+
+    WORLD_FRAME f = frame(1, { agent(1, 0, 0, robot, red), agent(4, 125.75, -40.5, block, blue), agent(9, 1e5, 3, robot, blue) });
+    f.agents[1].decoration = "<circle r=\"3\"/>";
+    f.agents[1].label = "héllo";
+    f.agents[1].label_x = 4;
+    f.agents[1].label_y = -4;
+
+    StateEncoder encoder;
+    json results = decode({ encoder.encode(f, 0, 0, false) });
+    expect_same(f, results[0]["state"], false);
+
+}
+
+TEST_F(StateEncoderTest, QuantizedRoundTrip) {
+
+    std::vector<AGENT_RECORD> agents;
+    for ( int i=0; i<50; i++ ) {
+        agents.push_back(agent(i, 20 * i - 400, 7.5 * i, i % 2 ? robot : block, i % 3 ? red : blue));
+    }
+    agents[10].label = "ten";
+    WORLD_FRAME f = frame(2, agents);
+
+    StateEncoder encoder;
+    json results = decode({ encoder.encode(f, 0, 0, true) });
+    expect_same(f, results[0]["state"], true);
+
+}
+
+TEST_F(StateEncoderTest, KnownEntriesAreNotResent) {
+
+    WORLD_FRAME f1 = frame(1, { agent(1, 0, 0, robot, red) }),
+                f2 = frame(2, { agent(1, 1, 0, robot, red), agent(2, 5, 5, block, blue) });
+
+    // The second response carries only the two new entries, and the
+    // decoder resolves the first two from the response before
+    StateEncoder encoder;
+    std::string first = encoder.encode(f1, 0, 0, false);
+    ASSERT_EQ(encoder.table_size(), 2u);
+    std::string second = encoder.encode(f2, encoder.table_id(), 2, false);
+    json results = decode({ first, second });
+
+    expect_same(f1, results[0]["state"], false);
+    expect_same(f2, results[1]["state"], false);
+    EXPECT_EQ(results[1]["query"], "?format=binary&quantize=1&table=" + std::to_string(encoder.table_id()) + "&known=4");
+
+    // A response that skips entries the client does not have is refused,
+    // and the client then asks for the whole table
+    results = decode({ encoder.encode(f2, encoder.table_id(), 2, false) });
+    EXPECT_TRUE(results[0]["state"].is_null());
+    EXPECT_EQ(results[0]["query"], "?format=binary&quantize=1&table=0&known=0");
+
+}
@@ -0,0 +1,229 @@
+#include <map>
+#include "gtest/gtest.h"
+#include "state_stream.h"
+#include "bytes.h"
+
+// Round trips through the binary /stream format. The decoder here follows
+// the layout documented in state_stream.cc, the way StateStream in
+// client/src/enviro.js reads it, and applies each message to the agents
+// it already holds.
+
+using namespace enviro;
+
+namespace {
+
+    typedef struct {
+        uint32_t frame, baseline;
+        bool keyframe;
+        float center_x, center_y, zoom, interpolation;
+        uint32_t timestamp, updates, removals;
+    } HEADER;
+
+    std::string read_string(ByteReader& in) {
+        uint32_t n = in.u32();
+        return std::string((const char *) in.bytes(n), n);
+    }
+
+    HEADER decode(const std::string& message, std::map<int, AGENT_RECORD>& agents) {
+
+        ByteReader in((const unsigned char *) message.data(), message.size());
+        HEADER h;
+        EXPECT_EQ(in.u8(), STREAM_FORMAT_VERSION);
+        h.keyframe = in.u8() & STREAM_KEYFRAME;
+        h.frame = in.u32();
+        h.baseline = in.u32();
+        h.center_x = in.f32();
+        h.center_y = in.f32();
+        h.zoom = in.f32();
+        h.timestamp = in.u32();
+        h.interpolation = in.f32();
+        h.updates = in.u32();
+        h.removals = in.u32();
+
+        if ( h.keyframe ) {
+            agents.clear();
+        }
+        for ( uint32_t i=0; i<h.updates; i++ ) {
+            int id = in.u32();
+            uint8_t mask = in.u8();
+            AGENT_RECORD& a = agents[id];
+            a.id = id;
+            if ( mask & STREAM_POSE ) {
+                a.x = in.f32();
+                a.y = in.f32();
+                a.theta = in.f32();
+            }
+            if ( mask & STREAM_VELOCITY ) {
+                a.vx = in.f32();
+                a.vy = in.f32();
+                a.omega = in.f32();
+            }
+            if ( mask & STREAM_SENSORS ) {
+                a.sensors.resize(in.u8());
+                for ( auto& s : a.sensors ) {
+                    s = in.f32();
+                }
+            }
+            if ( mask & STREAM_SPECIFICATION ) {
+                a.specification = std::make_shared<const std::string>(read_string(in));
+            }
+            if ( mask & STREAM_DECORATION ) {
+                a.decoration = read_string(in);
+            }
+            if ( mask & STREAM_LABEL ) {
+                a.label_x = in.f32();
+                a.label_y = in.f32();
+                a.label = read_string(in);
+            }
+        }
+        for ( uint32_t i=0; i<h.removals; i++ ) {
+            agents.erase(in.u32());
+        }
+        EXPECT_TRUE(in.done());
+        return h;
+
+    }
+
+    AGENT_RECORD agent(int id, double x, double y, std::shared_ptr<const std::string> spec) {
+        AGENT_RECORD a = {};
+        a.id = id;
+        a.x = x;
+        a.y = y;
+        a.theta = 0.25 * id;
+        a.vx = 1.5;
+        a.vy = -2.5;
+        a.omega = 0.125;
+        a.sensors = { 10.0 * id, 20.0 * id };
+        a.specification = spec;
+        a.decoration = "<circle r=3/>";
+        a.label = "agent " + std::to_string(id);
+        return a;
+    }
+
+    std::shared_ptr<WORLD_FRAME> frame(uint32_t number, std::vector<AGENT_RECORD> agents) {
+        auto f = std::make_shared<WORLD_FRAME>();
+        f->number = number;
+        f->center_x = 12;
+        f->center_y = -4;
+        f->zoom = 1.5;
+        f->interpolation = 0.5;
+        f->timestamp = 1000 + number;
+        f->agents = agents;
+        return f;
+    }
+
+    // Every agent in the frame, at the precision of the stream
+    void expect_same(const WORLD_FRAME& f, const std::map<int, AGENT_RECORD>& agents) {
+        ASSERT_EQ(agents.size(), f.agents.size());
+        for ( auto& a : f.agents ) {
+            auto i = agents.find(a.id);
+            ASSERT_NE(i, agents.end()) << "agent " << a.id;
+            const AGENT_RECORD& b = i->second;
+            EXPECT_EQ((float) a.x, b.x);
+            EXPECT_EQ((float) a.y, b.y);
+            EXPECT_EQ((float) a.theta, b.theta);
+            EXPECT_EQ((float) a.vx, b.vx);
+            EXPECT_EQ((float) a.vy, b.vy);
+            EXPECT_EQ((float) a.omega, b.omega);
+            ASSERT_EQ(a.sensors.size(), b.sensors.size());
+            for ( size_t j=0; j<a.sensors.size(); j++ ) {
+                EXPECT_EQ((float) a.sensors[j], b.sensors[j]);
+            }
+            EXPECT_EQ(*a.specification, *b.specification);
+            EXPECT_EQ(a.decoration, b.decoration);
+            EXPECT_EQ(a.label, b.label);
+            EXPECT_EQ((float) a.label_x, b.label_x);
+            EXPECT_EQ((float) a.label_y, b.label_y);
+        }
+    }
+
+}
+
+TEST(StateStream, KeyframeRoundTrip) {
+
+    auto spec = std::make_shared<const std::string>("{\"name\":\"robot\"}");
+    auto f = frame(7, { agent(1, 0, 0, spec), agent(2, 3.25, -8, spec), agent(5, 1e6, 1e-3, spec) });
+
+    StateStream stream;
+    ASSERT_TRUE(stream.publish(f));
+    ASSERT_FALSE(stream.publish(f));
+
+    std::map<int, AGENT_RECORD> agents;
+    HEADER h = decode(stream.encode(0), agents);
+    EXPECT_TRUE(h.keyframe);
+    EXPECT_EQ(h.frame, 7u);
+    EXPECT_EQ(h.timestamp, 1007u);
+    EXPECT_EQ(h.center_x, 12);
+    EXPECT_EQ(h.zoom, 1.5);
+    EXPECT_EQ(h.updates, 3u);
+    expect_same(*f, agents);
+
+}
+
+TEST(StateStream, DeltasRebuildEachFrame) {
+
+    auto spec = std::make_shared<const std::string>("{\"name\":\"robot\"}");
+    auto other = std::make_shared<const std::string>("{\"name\":\"robot\",\"style\":{\"fill\":\"red\"}}");
+
+    std::vector<AGENT_RECORD> agents = { agent(1, 0, 0, spec), agent(2, 5, 5, spec), agent(3, 9, 9, spec) };
+    auto f1 = frame(1, agents);
+
+    // Agent 1 moves, agent 2 is unchanged, agent 3 is removed, agent 4 is
+    // added, and agent 2 then changes everything but its pose
+    agents[0].x = 1;
+    agents.erase(agents.begin() + 2);
+    agents.push_back(agent(4, -1, -1, spec));
+    auto f2 = frame(2, agents);
+
+    agents[1].sensors = { 1, 2, 3 };
+    agents[1].specification = other;
+    agents[1].decoration = "";
+    agents[1].label = "changed";
+    agents[1].label_x = 4;
+    auto f3 = frame(3, agents);
+
+    StateStream stream;
+    std::map<int, AGENT_RECORD> decoded;
+
+    stream.publish(f1);
+    EXPECT_TRUE(decode(stream.encode(0), decoded).keyframe);
+    expect_same(*f1, decoded);
+    std::map<int, AGENT_RECORD> behind = decoded;
+
+    stream.publish(f2);
+    HEADER h = decode(stream.encode(1), decoded);
+    EXPECT_FALSE(h.keyframe);
+    EXPECT_EQ(h.baseline, 1u);
+    EXPECT_EQ(h.updates, 2u);
+    EXPECT_EQ(h.removals, 1u);
+    expect_same(*f2, decoded);
+
+    stream.publish(f3);
+    h = decode(stream.encode(2), decoded);
+    EXPECT_EQ(h.updates, 1u);
+    EXPECT_EQ(h.removals, 0u);
+    expect_same(*f3, decoded);
+
+    // A client still on the first frame gets both changes at once
+    h = decode(stream.encode(1), behind);
+    EXPECT_EQ(h.baseline, 1u);
+    EXPECT_EQ(h.removals, 1u);
+    expect_same(*f3, behind);
+
+}
+
+TEST(StateStream, LostBaselineSendsKeyframe) {
+
+    auto spec = std::make_shared<const std::string>("{}");
+    StateStream stream(2);
+    for ( uint32_t n=1; n<=4; n++ ) {
+        stream.publish(frame(n, { agent(1, n, n, spec) }));
+    }
+
+    std::map<int, AGENT_RECORD> decoded;
+    EXPECT_TRUE(decode(stream.encode(1), decoded).keyframe);
+    EXPECT_FALSE(decode(stream.encode(3), decoded).keyframe);
+    EXPECT_EQ(&stream.encode(3), &stream.encode(3));
+    EXPECT_EQ(decoded[1].x, 4);
+
+}
@@ -62,15 +62,11 @@ class FollowerController : public Process, public AgentInterface {
         bool leader_found = false;
         double leader_x = 0, leader_y = 0;
         
-        try {
-            if ( agent_exists(leader_id) ) {
-                Agent& leader = find_agent(leader_id);
-                leader_x = leader.x();
-                leader_y = leader.y();
-                leader_found = true;
-            }
-        } catch (...) {
-            leader_found = false;
+        Agent * leader = lookup_agent(leader_id);
+        if ( leader != NULL ) {
+            leader_x = leader->x();
+            leader_y = leader->y();
+            leader_found = true;
         }
         
         // If currently turning 90 degrees clockwise, continue until complete